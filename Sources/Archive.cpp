@@ -0,0 +1,225 @@
+#include "pch.h"
+
+#include "Archive.h"
+#include "LZ4.h"
+#include "Profiler.h"
+
+#include <Kore/Log.h>
+#include <Kore/Math/Core.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	MappedFile archive;
+	const u8* mapped = nullptr;
+	size_t mappedSize = 0;
+	
+	const ArchiveHeader* header = nullptr;
+	const ArchiveEntry* entries = nullptr;
+	const char* names = nullptr;
+	
+	bool validate() {
+		if (mappedSize < sizeof(ArchiveHeader)) return false;
+		header = (const ArchiveHeader*)mapped;
+		if (header->magic != archiveMagic || header->version != archiveVersion) return false;
+		if (sizeof(ArchiveHeader) + (size_t)header->numEntries * sizeof(ArchiveEntry) > header->namesOffset || header->namesOffset > mappedSize) return false;
+		
+		entries = (const ArchiveEntry*)(mapped + sizeof(ArchiveHeader));
+		names = (const char*)(mapped + header->namesOffset);
+		for (u32 i = 0; i < header->numEntries; ++i) {
+			if (entries[i].offset + entries[i].storedSize > mappedSize || header->namesOffset + entries[i].nameOffset >= mappedSize) return false;
+		}
+		return true;
+	}
+}
+
+MappedFile::MappedFile() : mapped(nullptr), length(0), file(nullptr), mapping(nullptr) {
+	
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const char* filename) {
+	close();
+	
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(handle);
+		return false;
+	}
+	
+	HANDLE view = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* pointer = view != nullptr ? MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (pointer == nullptr) {
+		if (view != nullptr) CloseHandle(view);
+		CloseHandle(handle);
+		return false;
+	}
+	
+	file = handle;
+	mapping = view;
+	mapped = (const u8*)pointer;
+	length = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped == nullptr) return;
+	UnmapViewOfFile(mapped);
+	CloseHandle((HANDLE)mapping);
+	CloseHandle((HANDLE)file);
+	mapped = nullptr;
+	length = 0;
+	file = nullptr;
+	mapping = nullptr;
+}
+#else
+bool MappedFile::open(const char* filename) {
+	close();
+	
+	int handle = ::open(filename, O_RDONLY);
+	if (handle < 0) return false;
+	
+	struct stat status;
+	if (fstat(handle, &status) != 0 || status.st_size == 0) {
+		::close(handle);
+		return false;
+	}
+	
+	// The mapping stays valid after closing the file
+	void* pointer = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+	::close(handle);
+	if (pointer == MAP_FAILED) return false;
+	
+	mapped = (const u8*)pointer;
+	length = (size_t)status.st_size;
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped == nullptr) return;
+	munmap((void*)mapped, length);
+	mapped = nullptr;
+	length = 0;
+}
+#endif
+
+bool Archive::open(const char* filename) {
+	close();
+	
+	if (!archive.open(filename)) return false;
+	mapped = archive.data();
+	mappedSize = archive.size();
+	
+	if (!validate()) {
+		log(Warning, "%s is not a valid archive", filename);
+		close();
+		return false;
+	}
+	log(Info, "Reading %d files from %s", (int)header->numEntries, filename);
+	return true;
+}
+
+void Archive::close() {
+	if (mapped == nullptr) return;
+	archive.close();
+	mapped = nullptr;
+	mappedSize = 0;
+	header = nullptr;
+	entries = nullptr;
+	names = nullptr;
+}
+
+bool Archive::isOpen() {
+	return mapped != nullptr;
+}
+
+const ArchiveEntry* Archive::find(const char* filename) {
+	if (mapped == nullptr) return nullptr;
+	
+	// The index is sorted by hash
+	u64 hash = archiveHash(filename);
+	int first = 0;
+	int last = header->numEntries;
+	while (first < last) {
+		int middle = (first + last) / 2;
+		if (entries[middle].hash < hash) first = middle + 1;
+		else last = middle;
+	}
+	
+	// Different names may have the same hash
+	for (int i = first; i < (int)header->numEntries && entries[i].hash == hash; ++i) {
+		if (strcmp(names + entries[i].nameOffset, filename) == 0) return &entries[i];
+	}
+	return nullptr;
+}
+
+const u8* Archive::data(const ArchiveEntry* entry) {
+	return mapped + entry->offset;
+}
+
+AssetFile::AssetFile(const char* filename) : contents(nullptr), length(0), buffer(nullptr), reader(nullptr) {
+	const ArchiveEntry* entry = Archive::find(filename);
+	if (entry == nullptr) {
+		reader = new FileReader(filename, FileReader::Asset);
+		contents = reader->readAll();
+		length = reader->size();
+		return;
+	}
+	
+	length = entry->size;
+	if ((entry->flags & ArchiveEntryLZ4) == 0) {
+		contents = Archive::data(entry);
+		return;
+	}
+	
+	PROFILE_ZONE("Decompress asset");
+	buffer = new u8[length];
+	if (LZ4::decompress(Archive::data(entry), entry->storedSize, buffer, length) != length) {
+		log(Error, "The archive entry of %s is corrupt", filename);
+		length = 0;
+	}
+	contents = buffer;
+}
+
+AssetFile::~AssetFile() {
+	delete[] buffer;
+	delete reader;
+}
+
+int AssetFileReader::read(void* data, int size) {
+	int count = Kore::min(size, file.size() - position);
+	memcpy(data, (const u8*)file.data() + position, count);
+	position += count;
+	return count;
+}
+
+int AssetFileReader::size() const {
+	return file.size();
+}
+
+int AssetFileReader::pos() const {
+	return position;
+}
+
+void AssetFileReader::seek(int pos) {
+	position = Kore::max(0, Kore::min(pos, file.size()));
+}
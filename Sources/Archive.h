@@ -0,0 +1,104 @@
+#pragma once
+
+#include "pch.h"
+
+#include <Kore/IO/Reader.h>
+#include <Kore/IO/FileReader.h>
+
+#include "ArchiveFormat.h"
+
+// A read only view of a whole file, mmap or MapViewOfFile
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+	
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	
+	// Returns false when the file does not exist or is empty
+	bool open(const char* filename);
+	
+	void close();
+	
+	const Kore::u8* data() const {
+		return mapped;
+	}
+	
+	size_t size() const {
+		return length;
+	}
+	
+private:
+	const Kore::u8* mapped;
+	size_t length;
+	
+	// The file and mapping handles on Windows
+	void* file;
+	void* mapping;
+};
+
+// The packed files of Deployment (see Tools/Packer). The archive is memory mapped, so files that are stored
+// uncompressed are used in place without reading or copying them. Files that are not in the archive are read from disk.
+namespace Archive {
+	// Map the archive, returns false when it does not exist or is not valid
+	bool open(const char* filename = "assets.pak");
+	
+	void close();
+	
+	bool isOpen();
+	
+	// The entry of a file, nullptr when the archive does not contain it. Can be called from any thread.
+	const ArchiveEntry* find(const char* filename);
+	
+	// What is stored for an entry, compressed when its flags say so
+	const Kore::u8* data(const ArchiveEntry* entry);
+}
+
+// The contents of a file, taken from the archive when it contains the file and read from disk otherwise
+class AssetFile {
+public:
+	explicit AssetFile(const char* filename);
+	~AssetFile();
+	
+	AssetFile(const AssetFile&) = delete;
+	AssetFile& operator=(const AssetFile&) = delete;
+	
+	const void* data() const {
+		return contents;
+	}
+	
+	int size() const {
+		return length;
+	}
+	
+	// Is the file in the archive?
+	bool isPacked() const {
+		return reader == nullptr;
+	}
+	
+private:
+	const void* contents;
+	int length;
+	
+	// Holds compressed entries after decompressing them
+	Kore::u8* buffer;
+	
+	// Only used for files that are not in the archive
+	Kore::FileReader* reader;
+};
+
+// Reads an AssetFile through the Reader interface, e.g. to decode an image from it
+class AssetFileReader : public Kore::Reader {
+public:
+	explicit AssetFileReader(const AssetFile& file) : file(file), position(0) {}
+	
+	int read(void* data, int size) override;
+	int size() const override;
+	int pos() const override;
+	void seek(int pos) override;
+	
+private:
+	const AssetFile& file;
+	int position;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+// The layout of the asset archive, shared by the runtime (see Archive) and Tools/Packer.
+// An archive is a header, the index sorted by hash, the null terminated names and then the entry data.
+// Everything is little endian and the data of every entry starts at a multiple of archiveAlignment,
+// so that it can be used in place when the archive is mapped.
+const uint32_t archiveMagic = 0x4b41504b; // "KPAK"
+const uint32_t archiveVersion = 1;
+const int archiveAlignment = 16;
+
+struct ArchiveHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numEntries;
+	// The offset of the names from the start of the archive
+	uint32_t namesOffset;
+};
+
+enum ArchiveEntryFlags {
+	ArchiveEntryLZ4 = 1
+};
+
+struct ArchiveEntry {
+	// archiveHash of the name
+	uint64_t hash;
+	// The offset of the name in the names
+	uint32_t nameOffset;
+	uint32_t flags;
+	// The offset of the data from the start of the archive
+	uint64_t offset;
+	// The size of the file and of what is stored for it, which only differ when compressed
+	uint32_t size;
+	uint32_t storedSize;
+};
+
+static_assert(sizeof(ArchiveHeader) == 16 && sizeof(ArchiveEntry) == 32, "The archive layout must not depend on the compiler");
+
+// FNV-1a of a path relative to Deployment with / as the separator
+inline uint64_t archiveHash(const char* name) {
+	uint64_t hash = 14695981039346656037ull;
+	for (const char* c = name; *c != 0; ++c) {
+		hash ^= (uint8_t)*c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
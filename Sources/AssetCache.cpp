@@ -0,0 +1,264 @@
+#include "pch.h"
+
+#include "AssetCache.h"
+#include "MeshObject.h"
+#include "ShaderProgram.h"
+
+#include "Archive.h"
+#include <Kore/Log.h>
+#include <assert.h>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	const int maxEntries = 128;
+	const int maxPathLength = 128;
+	
+	enum AssetType {
+		MeshAsset,
+		TextureAsset,
+		ShaderAsset,
+		ProgramAsset
+	};
+	
+	const char* typeNames[] = { "mesh", "texture", "shader", "program" };
+	
+	struct Entry {
+		AssetType type;
+		char path[maxPathLength];
+		// Second file of a program
+		char path2[maxPathLength];
+		
+		// Load parameters that are part of the key
+		Graphics4::VertexStructure structure;
+		Graphics4::VertexStructure* instanceStructure;
+		float scale;
+		bool depthWrite;
+		
+		int references;
+		void* asset;
+	};
+	
+	// All entries in use are at the front
+	Entry entries[maxEntries];
+	int numEntries = 0;
+	
+	bool sameStructure(const Graphics4::VertexStructure& a, const Graphics4::VertexStructure& b) {
+		if (a.size != b.size) return false;
+		for (int i = 0; i < a.size; ++i) {
+			if (a.elements[i].data != b.elements[i].data) return false;
+			if (strcmp(a.elements[i].name, b.elements[i].name) != 0) return false;
+		}
+		return true;
+	}
+	
+	Entry* find(AssetType type, const char* path) {
+		for (int i = 0; i < numEntries; ++i) {
+			if (entries[i].type == type && strcmp(entries[i].path, path) == 0) return &entries[i];
+		}
+		return nullptr;
+	}
+	
+	Entry* findAsset(void* asset) {
+		for (int i = 0; i < numEntries; ++i) {
+			if (entries[i].asset == asset) return &entries[i];
+		}
+		return nullptr;
+	}
+	
+	Entry* add(AssetType type, const char* path, void* asset) {
+		assert(numEntries < maxEntries);
+		assert(strlen(path) < maxPathLength);
+		Entry* entry = &entries[numEntries++];
+		entry->type = type;
+		strcpy(entry->path, path);
+		entry->path2[0] = 0;
+		entry->scale = 1.0f;
+		entry->depthWrite = false;
+		entry->instanceStructure = nullptr;
+		entry->references = 1;
+		entry->asset = asset;
+		return entry;
+	}
+	
+	void remove(Entry* entry) {
+		*entry = entries[--numEntries];
+	}
+	
+	Graphics4::Shader* getShader(const char* filename, Graphics4::ShaderType shaderType) {
+		Entry* entry = find(ShaderAsset, filename);
+		if (entry != nullptr) {
+			++entry->references;
+			return (Graphics4::Shader*)entry->asset;
+		}
+		// Packed shaders are compiled straight from the mapped archive
+		AssetFile file(filename);
+		Graphics4::Shader* shader = new Graphics4::Shader((void*)file.data(), file.size(), shaderType);
+		add(ShaderAsset, filename, shader);
+		return shader;
+	}
+	
+	void releaseShader(Graphics4::Shader* shader) {
+		Entry* entry = findAsset(shader);
+		assert(entry != nullptr);
+		if (--entry->references == 0) {
+			delete shader;
+			remove(entry);
+		}
+	}
+	
+	Entry* findMesh(const char* filename, const Graphics4::VertexStructure& structure, float scale) {
+		for (int i = 0; i < numEntries; ++i) {
+			Entry* entry = &entries[i];
+			if (entry->type == MeshAsset && strcmp(entry->path, filename) == 0 && entry->scale == scale && sameStructure(entry->structure, structure)) return entry;
+		}
+		return nullptr;
+	}
+	
+	void freeMesh(MeshHandle* mesh) {
+		delete mesh->vertexBuffer;
+		for (int lod = 0; lod < mesh->numLods; ++lod) {
+			delete mesh->lodIndexBuffers[lod];
+		}
+		delete mesh;
+	}
+	
+	void freeTexture(TextureHandle* texture) {
+		delete texture->texture;
+		delete texture;
+	}
+	
+	// Assets that are still loading can not be freed, they stay cached without references and are freed on the next release
+	void releaseUnreferenced() {
+		for (int i = numEntries - 1; i >= 0; --i) {
+			Entry* entry = &entries[i];
+			if (entry->references > 0) continue;
+			if (entry->type == MeshAsset) {
+				MeshHandle* mesh = (MeshHandle*)entry->asset;
+				if (!mesh->isReady()) continue;
+				freeMesh(mesh);
+				remove(entry);
+			}
+			else if (entry->type == TextureAsset) {
+				TextureHandle* texture = (TextureHandle*)entry->asset;
+				if (!texture->isReady()) continue;
+				freeTexture(texture);
+				remove(entry);
+			}
+		}
+	}
+}
+
+MeshHandle* AssetCache::getMesh(const char* filename, const Graphics4::VertexStructure& structure, float scale) {
+	Entry* cached = findMesh(filename, structure, scale);
+	if (cached != nullptr) {
+		++cached->references;
+		return (MeshHandle*)cached->asset;
+	}
+	MeshHandle* mesh = AssetLoader::loadMesh(filename, structure, scale);
+	Entry* entry = add(MeshAsset, filename, mesh);
+	entry->structure = structure;
+	entry->scale = scale;
+	return mesh;
+}
+
+TextureHandle* AssetCache::getTexture(const char* filename) {
+	Entry* entry = find(TextureAsset, filename);
+	if (entry != nullptr) {
+		++entry->references;
+		return (TextureHandle*)entry->asset;
+	}
+	TextureHandle* texture = AssetLoader::loadTexture(filename);
+	add(TextureAsset, filename, texture);
+	return texture;
+}
+
+ShaderProgram* AssetCache::getShaderProgram(const char* vsFile, const char* fsFile, Graphics4::VertexStructure& structure, bool depthWrite, Graphics4::VertexStructure* instanceStructure) {
+	for (int i = 0; i < numEntries; ++i) {
+		Entry* entry = &entries[i];
+		if (entry->type == ProgramAsset && strcmp(entry->path, vsFile) == 0 && strcmp(entry->path2, fsFile) == 0 && entry->depthWrite == depthWrite && sameStructure(entry->structure, structure) && entry->instanceStructure == instanceStructure) {
+			++entry->references;
+			return (ShaderProgram*)entry->asset;
+		}
+	}
+	Graphics4::Shader* vertexShader = getShader(vsFile, Graphics4::VertexShader);
+	Graphics4::Shader* fragmentShader = getShader(fsFile, Graphics4::FragmentShader);
+	ShaderProgram* program = new ShaderProgram(vertexShader, fragmentShader, structure, depthWrite, instanceStructure);
+	
+	assert(strlen(fsFile) < maxPathLength);
+	Entry* entry = add(ProgramAsset, vsFile, program);
+	strcpy(entry->path2, fsFile);
+	entry->structure = structure;
+	entry->depthWrite = depthWrite;
+	entry->instanceStructure = instanceStructure;
+	return program;
+}
+
+MeshHandle* AssetCache::addMesh(const char* filename, const Graphics4::VertexStructure& structure, float scale, MeshHandle* mesh) {
+	Entry* cached = findMesh(filename, structure, scale);
+	if (cached != nullptr) {
+		freeMesh(mesh);
+		++cached->references;
+		return (MeshHandle*)cached->asset;
+	}
+	Entry* entry = add(MeshAsset, filename, mesh);
+	entry->structure = structure;
+	entry->scale = scale;
+	return mesh;
+}
+
+TextureHandle* AssetCache::addTexture(const char* filename, TextureHandle* texture) {
+	Entry* cached = find(TextureAsset, filename);
+	if (cached != nullptr) {
+		freeTexture(texture);
+		++cached->references;
+		return (TextureHandle*)cached->asset;
+	}
+	add(TextureAsset, filename, texture);
+	return texture;
+}
+
+MeshObject* AssetCache::createMeshObject(const char* meshFile, const char* textureFile, const Graphics4::VertexStructure& structure, ShaderProgram* shaderProgram, float scale) {
+	return new MeshObject(getMesh(meshFile, structure, scale), getTexture(textureFile), shaderProgram);
+}
+
+void AssetCache::release(MeshHandle* mesh) {
+	Entry* entry = findAsset(mesh);
+	assert(entry != nullptr && entry->references > 0);
+	--entry->references;
+	releaseUnreferenced();
+}
+
+void AssetCache::release(TextureHandle* texture) {
+	Entry* entry = findAsset(texture);
+	assert(entry != nullptr && entry->references > 0);
+	--entry->references;
+	releaseUnreferenced();
+}
+
+void AssetCache::release(ShaderProgram* program) {
+	Entry* entry = findAsset(program);
+	assert(entry != nullptr && entry->references > 0);
+	if (--entry->references > 0) return;
+	
+	Graphics4::Shader* vertexShader = program->getVertexShader();
+	Graphics4::Shader* fragmentShader = program->getFragmentShader();
+	delete program;
+	remove(entry);
+	releaseShader(vertexShader);
+	releaseShader(fragmentShader);
+}
+
+void AssetCache::release(MeshObject* meshObject) {
+	release(meshObject->getMesh());
+	release(meshObject->getTexture());
+	delete meshObject;
+}
+
+void AssetCache::report() {
+	log(Info, "Asset cache: %i entries", numEntries);
+	for (int i = 0; i < numEntries; ++i) {
+		log(Info, "  %s %s%s%s: %i references", typeNames[entries[i].type], entries[i].path, entries[i].path2[0] != 0 ? " " : "", entries[i].path2, entries[i].references);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "pch.h"
+
+#include <Kore/Graphics4/Graphics.h>
+
+#include "AssetLoader.h"
+
+class MeshObject;
+class ShaderProgram;
+
+// Shares loaded assets between their users. Assets are keyed by file name and load parameters,
+// every get increases the reference count and every release decreases it. Assets are freed
+// when they are not referenced anymore.
+namespace AssetCache {
+	// Loads asynchronously on first use (see AssetLoader)
+	MeshHandle* getMesh(const char* filename, const Kore::Graphics4::VertexStructure& structure, float scale = 1.0f);
+	TextureHandle* getTexture(const char* filename);
+	
+	// Shaders are compiled once per file, the pipeline once per file pair, vertex structures and depthWrite setting
+	ShaderProgram* getShaderProgram(const char* vsFile, const char* fsFile, Kore::Graphics4::VertexStructure& structure, bool depthWrite, Kore::Graphics4::VertexStructure* instanceStructure = nullptr);
+	
+	// Share assets that the caller loaded on its own (see AssetLoader::decodeMesh). Returns the shared asset,
+	// the caller holds a reference to it which it has to release. When the asset was cached already,
+	// the one that was passed in is freed and the cached one is returned.
+	MeshHandle* addMesh(const char* filename, const Kore::Graphics4::VertexStructure& structure, float scale, MeshHandle* mesh);
+	TextureHandle* addTexture(const char* filename, TextureHandle* texture);
+	
+	// A new MeshObject that uses the shared mesh and texture
+	MeshObject* createMeshObject(const char* meshFile, const char* textureFile, const Kore::Graphics4::VertexStructure& structure, ShaderProgram* shaderProgram, float scale = 1.0f);
+	
+	void release(MeshHandle* mesh);
+	void release(TextureHandle* texture);
+	void release(ShaderProgram* program);
+	void release(MeshObject* meshObject);
+	
+	// Log the resident assets and their reference counts
+	void report();
+}
@@ -0,0 +1,315 @@
+#include "pch.h"
+
+#include "AssetLoader.h"
+#include "Jobs.h"
+#include "MeshObject.h"
+#include "ObjLoader.h"
+#include "MeshSimplifier.h"
+#include "Profiler.h"
+#include "Counters.h"
+#include "TextureCache.h"
+
+#include <Kore/Graphics1/Image.h>
+#include <Kore/Threads/Mutex.h>
+#include <Kore/System.h>
+#include <Kore/Log.h>
+#include <math.h>
+#include <string.h>
+
+using namespace Kore;
+
+namespace {
+	// One asset load, owned by a worker until it is decoded and by the render thread afterwards
+	struct LoadRequest {
+		const char* meshFile;
+		const char* textureFile;
+		
+		// Set by the worker
+		Mesh* mesh;
+		AssetLoader::DecodedTexture texture;
+		
+		// The targets to fill on upload
+		MeshHandle* meshHandle;
+		TextureHandle* textureHandle;
+		
+		Graphics4::VertexStructure structure;
+		float scale;
+		
+		LoadRequest* next;
+	};
+	
+	// Decoded requests waiting for upload, protected by mutex
+	LoadRequest* firstDecoded = nullptr;
+	LoadRequest* lastDecoded = nullptr;
+	Mutex mutex;
+	
+	// Only touched on the render thread
+	int pendingCount = 0;
+	
+	void decode(void* param) {
+		LoadRequest* request = (LoadRequest*)param;
+		if (request->meshFile != nullptr) {
+			request->mesh = AssetLoader::decodeMesh(request->meshFile);
+		}
+		if (request->textureFile != nullptr) {
+			request->texture = AssetLoader::decodeTexture(request->textureFile);
+		}
+		
+		mutex.Lock();
+		if (lastDecoded == nullptr) {
+			firstDecoded = request;
+		}
+		else {
+			lastDecoded->next = request;
+		}
+		lastDecoded = request;
+		mutex.Unlock();
+	}
+	
+	LoadRequest* popDecoded() {
+		mutex.Lock();
+		LoadRequest* request = firstDecoded;
+		if (request != nullptr) {
+			firstDecoded = request->next;
+			if (firstDecoded == nullptr) lastDecoded = nullptr;
+		}
+		mutex.Unlock();
+		return request;
+	}
+	
+	Graphics4::Texture* createTexture(Image* image) {
+		Graphics4::Texture* texture = new Graphics4::Texture(image->width, image->height, image->format, false);
+		u8* pixels = texture->lock();
+		int stride = texture->stride();
+		int rowSize = image->width * Image::sizeOf(image->format);
+		for (int y = 0; y < image->height; ++y) {
+			memcpy(&pixels[y * stride], &image->data[y * rowSize], rowSize);
+		}
+		texture->unlock();
+		Counters::add(Counters::BytesUploaded, stride * image->height);
+		
+		// The samplers use mipmaps
+		int levels = 1;
+		while ((image->width >> levels) > 0 || (image->height >> levels) > 0) ++levels;
+		texture->generateMipmaps(levels);
+		delete image;
+		return texture;
+	}
+	
+	void upload(LoadRequest* request) {
+		if (request->meshHandle != nullptr) {
+			AssetLoader::uploadMesh(request->meshHandle, request->mesh, request->structure, request->scale);
+		}
+		if (request->textureHandle != nullptr) {
+			AssetLoader::uploadTexture(request->textureHandle, request->texture);
+		}
+		
+		delete request;
+		--pendingCount;
+	}
+	
+	void uploadIndices(MeshHandle* handle, Mesh* mesh) {
+		for (int lod = 0; lod < mesh->numLods; ++lod) {
+			Graphics4::IndexBuffer* indexBuffer = new Graphics4::IndexBuffer(mesh->lodIndexCounts[lod]);
+			int* indices = indexBuffer->lock();
+			for (int i = 0; i < mesh->lodIndexCounts[lod]; i++) {
+				indices[i] = mesh->lodIndices[lod][i];
+			}
+			indexBuffer->unlock();
+			Counters::add(Counters::BytesUploaded, mesh->lodIndexCounts[lod] * sizeof(int));
+			handle->lodIndexBuffers[lod] = indexBuffer;
+		}
+		handle->numLods = mesh->numLods;
+		handle->indexBuffer = handle->lodIndexBuffers[0];
+	}
+	
+	LoadRequest* createRequest() {
+		LoadRequest* request = new LoadRequest;
+		request->meshFile = nullptr;
+		request->textureFile = nullptr;
+		request->mesh = nullptr;
+		request->texture.cached = nullptr;
+		request->texture.image = nullptr;
+		request->meshHandle = nullptr;
+		request->textureHandle = nullptr;
+		request->scale = 1.0f;
+		request->next = nullptr;
+		return request;
+	}
+	
+	short snorm16(float value) {
+		if (value > 1.0f) value = 1.0f;
+		if (value < -1.0f) value = -1.0f;
+		return (short)floorf(value * 32767.0f + 0.5f);
+	}
+	
+	// Project the normal onto the octahedron and unfold the lower half
+	void encodeOctahedral(float x, float y, float z, short* result) {
+		float length = fabsf(x) + fabsf(y) + fabsf(z);
+		if (length == 0) {
+			result[0] = 0;
+			result[1] = 0;
+			return;
+		}
+		x /= length;
+		y /= length;
+		if (z < 0) {
+			float foldedX = (1.0f - fabsf(y)) * (x >= 0 ? 1.0f : -1.0f);
+			float foldedY = (1.0f - fabsf(x)) * (y >= 0 ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		result[0] = snorm16(x);
+		result[1] = snorm16(y);
+	}
+	
+	bool isCompressed(const Graphics4::VertexStructure& structure) {
+		return structure.elements[0].data == Graphics4::Short4NormVertexData;
+	}
+	
+	Graphics4::VertexBuffer* createCompressedVertexBuffer(MeshHandle* handle, Mesh* mesh, const Graphics4::VertexStructure& structure, float scale) {
+		float radius = mesh->boundsRadius > 0 ? mesh->boundsRadius : 1.0f;
+		const float* center = mesh->boundsCenter;
+		handle->decode = mat4::Translation(center[0] * scale, center[1] * scale, center[2] * scale) * mat4::Scale(radius * scale, radius * scale, radius * scale);
+		
+		bool clamped = false;
+		Graphics4::VertexBuffer* vertexBuffer = new Graphics4::VertexBuffer(mesh->numVertices, structure, 0);
+		short* vertices = (short*)vertexBuffer->lock();
+		for (int i = 0; i < mesh->numVertices; ++i) {
+			const float* vertex = &mesh->vertices[i * 8];
+			vertices[i * 8 + 0] = snorm16((vertex[0] - center[0]) / radius);
+			vertices[i * 8 + 1] = snorm16((vertex[1] - center[1]) / radius);
+			vertices[i * 8 + 2] = snorm16((vertex[2] - center[2]) / radius);
+			vertices[i * 8 + 3] = 0;
+			
+			float u = vertex[3];
+			float v = 1.0f - vertex[4];
+			if (fabsf(u) > AssetLoader::compressedUVRange || fabsf(v) > AssetLoader::compressedUVRange) clamped = true;
+			vertices[i * 8 + 4] = snorm16(u / AssetLoader::compressedUVRange);
+			vertices[i * 8 + 5] = snorm16(v / AssetLoader::compressedUVRange);
+			
+			encodeOctahedral(vertex[5], vertex[6], vertex[7], &vertices[i * 8 + 6]);
+		}
+		vertexBuffer->unlock();
+		Counters::add(Counters::BytesUploaded, mesh->numVertices * 8 * sizeof(short));
+		
+		if (clamped) {
+			log(Warning, "Texture coordinates outside of the compressed range were clamped");
+		}
+		return vertexBuffer;
+	}
+	
+	void queue(LoadRequest* request) {
+		++pendingCount;
+		Jobs::add(decode, request);
+	}
+}
+
+void AssetLoader::init() {
+	mutex.Create();
+}
+
+TextureHandle* AssetLoader::loadTexture(const char* filename) {
+	TextureHandle* handle = new TextureHandle;
+	handle->texture = nullptr;
+	
+	LoadRequest* request = createRequest();
+	request->textureFile = filename;
+	request->textureHandle = handle;
+	queue(request);
+	return handle;
+}
+
+MeshHandle* AssetLoader::loadMesh(const char* filename, const Graphics4::VertexStructure& structure, float scale) {
+	MeshHandle* handle = new MeshHandle;
+	handle->mesh = nullptr;
+	handle->scale = scale;
+	handle->vertexBuffer = nullptr;
+	handle->indexBuffer = nullptr;
+	handle->numLods = 0;
+	
+	LoadRequest* request = createRequest();
+	request->meshFile = filename;
+	request->meshHandle = handle;
+	request->structure = structure;
+	request->scale = scale;
+	queue(request);
+	return handle;
+}
+
+Mesh* AssetLoader::decodeMesh(const char* filename) {
+	Mesh* mesh = loadObj(filename);
+	generateLods(mesh);
+	return mesh;
+}
+
+AssetLoader::DecodedTexture AssetLoader::decodeTexture(const char* filename) {
+	DecodedTexture texture;
+	texture.cached = TextureCache::load(filename, &texture.image);
+	return texture;
+}
+
+void AssetLoader::uploadTexture(TextureHandle* handle, const DecodedTexture& texture) {
+	handle->texture = texture.cached != nullptr ? TextureCache::upload(texture.cached) : createTexture(texture.image);
+}
+
+MeshObject* AssetLoader::loadMeshObject(const char* meshFile, const char* textureFile, const Graphics4::VertexStructure& structure, ShaderProgram* shaderProgram, float scale) {
+	return new MeshObject(loadMesh(meshFile, structure, scale), loadTexture(textureFile), shaderProgram);
+}
+
+Graphics4::VertexStructure& AssetLoader::compressedStructure() {
+	static Graphics4::VertexStructure structure;
+	static bool initialized = false;
+	if (!initialized) {
+		structure.add("pos", Graphics4::Short4NormVertexData);
+		structure.add("tex", Graphics4::Short2NormVertexData);
+		structure.add("nor", Graphics4::Short2NormVertexData);
+		initialized = true;
+	}
+	return structure;
+}
+
+void AssetLoader::uploadMesh(MeshHandle* handle, Mesh* mesh, const Graphics4::VertexStructure& structure, float scale) {
+	handle->mesh = mesh;
+	handle->scale = scale;
+	handle->decode = mat4::Identity();
+	
+	if (isCompressed(structure)) {
+		Graphics4::VertexBuffer* vertexBuffer = createCompressedVertexBuffer(handle, mesh, structure, scale);
+		uploadIndices(handle, mesh);
+		handle->vertexBuffer = vertexBuffer;
+		return;
+	}
+	
+	Graphics4::VertexBuffer* vertexBuffer = new Graphics4::VertexBuffer(mesh->numVertices, structure, 0);
+	float* vertices = vertexBuffer->lock();
+	for (int i = 0; i < mesh->numVertices; ++i) {
+		vertices[i * 8 + 0] = mesh->vertices[i * 8 + 0] * scale;
+		vertices[i * 8 + 1] = mesh->vertices[i * 8 + 1] * scale;
+		vertices[i * 8 + 2] = mesh->vertices[i * 8 + 2] * scale;
+		vertices[i * 8 + 3] = mesh->vertices[i * 8 + 3];
+		vertices[i * 8 + 4] = 1.0f - mesh->vertices[i * 8 + 4];
+		vertices[i * 8 + 5] = mesh->vertices[i * 8 + 5];
+		vertices[i * 8 + 6] = mesh->vertices[i * 8 + 6];
+		vertices[i * 8 + 7] = mesh->vertices[i * 8 + 7];
+	}
+	vertexBuffer->unlock();
+	Counters::add(Counters::BytesUploaded, mesh->numVertices * 8 * sizeof(float));
+	
+	uploadIndices(handle, mesh);
+	handle->vertexBuffer = vertexBuffer;
+}
+
+void AssetLoader::processUploads(double budget) {
+	PROFILE_ZONE("AssetLoader::processUploads");
+	double start = System::time();
+	do {
+		LoadRequest* request = popDecoded();
+		if (request == nullptr) return;
+		upload(request);
+	} while (System::time() - start < budget);
+}
+
+int AssetLoader::pending() {
+	return pendingCount;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "pch.h"
+
+#include <Kore/Graphics4/Graphics.h>
+
+#include "ObjLoader.h"
+
+class MeshObject;
+class ShaderProgram;
+struct CachedTexture;
+
+namespace Kore {
+	class Image;
+}
+
+// A texture that is loaded in the background. texture stays nullptr until it has been uploaded.
+struct TextureHandle {
+	Kore::Graphics4::Texture* texture;
+	
+	bool isReady() const {
+		return texture != nullptr;
+	}
+};
+
+// The GPU buffers of a mesh. The buffers stay nullptr until they have been uploaded.
+struct MeshHandle {
+	Mesh* mesh;
+	
+	// The scale that was applied to the vertices
+	float scale;
+	
+	// Transforms the stored positions to mesh space, identity unless the vertices are compressed
+	Kore::mat4 decode;
+	
+	Kore::Graphics4::VertexBuffer* vertexBuffer;
+	Kore::Graphics4::IndexBuffer* indexBuffer;
+	
+	// One index buffer per level of detail, the first one is indexBuffer
+	Kore::Graphics4::IndexBuffer* lodIndexBuffers[maxMeshLods];
+	int numLods;
+	
+	bool isReady() const {
+		return vertexBuffer != nullptr;
+	}
+};
+
+// Loads assets asynchronously: Parsing and image decoding run on the worker threads (see Jobs),
+// the buffers and textures are created on the render thread in processUploads.
+namespace AssetLoader {
+	void init();
+	
+	// Start loading a texture, the handle is filled when the upload is done
+	TextureHandle* loadTexture(const char* filename);
+	
+	// Start loading a mesh, the handle is filled when the upload is done
+	MeshHandle* loadMesh(const char* filename, const Kore::Graphics4::VertexStructure& structure, float scale = 1.0f);
+	
+	// Returns a MeshObject immediately, it is rendered as soon as mesh and texture are uploaded
+	MeshObject* loadMeshObject(const char* meshFile, const char* textureFile, const Kore::Graphics4::VertexStructure& structure, ShaderProgram* shaderProgram, float scale = 1.0f);
+	
+	// A vertex layout with half the size of the float layout: Positions are snorm16 relative to the bounding sphere,
+	// uvs are snorm16 in [-compressedUVRange, compressedUVRange] and normals are octahedral encoded snorm16.
+	// Meshes loaded with it have to be drawn with shader_compressed.vert.
+	Kore::Graphics4::VertexStructure& compressedStructure();
+	
+	const float compressedUVRange = 8.0f;
+	
+	// A decoded image, from the texture cache when possible
+	struct DecodedTexture {
+		CachedTexture* cached;
+		Kore::Image* image;
+	};
+	
+	// The halves of a load, for callers that schedule them on their own (see TaskGraph).
+	// The decodes may run on several threads at once, the uploads have to be called on the render thread.
+	Mesh* decodeMesh(const char* filename);
+	DecodedTexture decodeTexture(const char* filename);
+	
+	// Create the buffers for a mesh right away
+	void uploadMesh(MeshHandle* handle, Mesh* mesh, const Kore::Graphics4::VertexStructure& structure, float scale);
+	
+	// Create the texture right away, frees the decoded data
+	void uploadTexture(TextureHandle* handle, const DecodedTexture& texture);
+	
+	// Upload finished loads, spending at most budget seconds (but at least one upload per call).
+	// Has to be called on the render thread, once per frame.
+	void processUploads(double budget);
+	
+	// The number of loads that are not uploaded yet
+	int pending();
+}
@@ -0,0 +1,254 @@
+#include "pch.h"
+
+#include "Collision.h"
+
+#include <Kore/Math/Core.h>
+
+#include <math.h>
+#include <float.h>
+
+using namespace Kore;
+
+namespace {
+	float clampf(float value, float low, float high) {
+		return value < low ? low : (value > high ? high : value);
+	}
+	
+	vec3 closestPointOnSegment(const vec3& point, const vec3& a, const vec3& b) {
+		vec3 ab = b - a;
+		float lengthSquared = ab.dot(ab);
+		if (lengthSquared <= 0) return a;
+		float t = clampf((point - a).dot(ab) / lengthSquared, 0, 1);
+		return a + ab * t;
+	}
+	
+	// The closest points of two segments (Ericson, Real-Time Collision Detection 5.1.9)
+	void closestPointsOfSegments(const vec3& a0, const vec3& a1, const vec3& b0, const vec3& b1, vec3& onA, vec3& onB) {
+		vec3 d1 = a1 - a0;
+		vec3 d2 = b1 - b0;
+		vec3 r = a0 - b0;
+		float a = d1.dot(d1);
+		float e = d2.dot(d2);
+		float f = d2.dot(r);
+		float s, t;
+		if (a <= FLT_EPSILON && e <= FLT_EPSILON) {
+			s = t = 0;
+		}
+		else if (a <= FLT_EPSILON) {
+			s = 0;
+			t = clampf(f / e, 0, 1);
+		}
+		else {
+			float c = d1.dot(r);
+			if (e <= FLT_EPSILON) {
+				t = 0;
+				s = clampf(-c / a, 0, 1);
+			}
+			else {
+				float b = d1.dot(d2);
+				float denominator = a * e - b * b;
+				s = denominator != 0 ? clampf((b * f - c * e) / denominator, 0, 1) : 0;
+				t = (b * s + f) / e;
+				if (t < 0) {
+					t = 0;
+					s = clampf(-c / a, 0, 1);
+				}
+				else if (t > 1) {
+					t = 1;
+					s = clampf((b - c) / a, 0, 1);
+				}
+			}
+		}
+		onA = a0 + d1 * s;
+		onB = b0 + d2 * t;
+	}
+	
+	// Two spheres given by center and radius, the only square root of most tests
+	bool contactSpheres(const vec3& centerA, float radiusA, const vec3& centerB, float radiusB, Contact& contact) {
+		vec3 difference = centerB - centerA;
+		float distanceSquared = difference.dot(difference);
+		float reach = radiusA + radiusB;
+		if (distanceSquared > reach * reach) return false;
+		
+		float distance = sqrtf(distanceSquared);
+		contact.normal = distance > 0 ? difference * (1.0f / distance) : vec3(0, 1, 0);
+		contact.depth = reach - distance;
+		contact.point = centerA + contact.normal * (radiusA - contact.depth * 0.5f);
+		return true;
+	}
+	
+	bool contactSphereBox(const vec3& center, float radius, const AABBCollider& box, Contact& contact) {
+		vec3 closest(clampf(center.x(), box.min.x(), box.max.x()), clampf(center.y(), box.min.y(), box.max.y()), clampf(center.z(), box.min.z(), box.max.z()));
+		vec3 difference = closest - center;
+		float distanceSquared = difference.dot(difference);
+		if (distanceSquared > radius * radius) return false;
+		
+		if (distanceSquared > 0) {
+			float distance = sqrtf(distanceSquared);
+			contact.normal = difference * (1.0f / distance);
+			contact.depth = radius - distance;
+			contact.point = closest;
+			return true;
+		}
+		
+		// The center is inside, push it out through the nearest face
+		int axis = 0;
+		float sign = 1;
+		float faceDistance = FLT_MAX;
+		for (int i = 0; i < 3; ++i) {
+			float toMin = center[i] - box.min[i];
+			float toMax = box.max[i] - center[i];
+			if (toMin < faceDistance) {
+				faceDistance = toMin;
+				axis = i;
+				sign = -1;
+			}
+			if (toMax < faceDistance) {
+				faceDistance = toMax;
+				axis = i;
+				sign = 1;
+			}
+		}
+		// The normal points from the sphere into the box, against the way out
+		contact.normal = vec3(0, 0, 0);
+		contact.normal[axis] = -sign;
+		contact.depth = faceDistance + radius;
+		contact.point = center;
+		return true;
+	}
+	
+	
+	// One function for every pair of types in table order, the normal points from the first to the second shape
+	
+	bool generate(const SphereCollider& a, const SphereCollider& b, Contact& contact) {
+		return contactSpheres(a.center, a.radius, b.center, b.radius, contact);
+	}
+	
+	bool generate(const SphereCollider& a, const PlaneCollider& b, Contact& contact) {
+		float distance = b.normal.dot(a.center) + b.d;
+		if (distance > a.radius) return false;
+		
+		contact.normal = b.normal * -1.0f;
+		contact.depth = a.radius - distance;
+		contact.point = a.center - b.normal * distance;
+		return true;
+	}
+	
+	bool generate(const SphereCollider& a, const CapsuleCollider& b, Contact& contact) {
+		return contactSpheres(a.center, a.radius, closestPointOnSegment(a.center, b.a, b.b), b.radius, contact);
+	}
+	
+	bool generate(const SphereCollider& a, const AABBCollider& b, Contact& contact) {
+		return contactSphereBox(a.center, a.radius, b, contact);
+	}
+	
+	bool generate(const PlaneCollider& a, const PlaneCollider& b, Contact& contact) {
+		// Planes are static
+		return false;
+	}
+	
+	bool generate(const PlaneCollider& a, const CapsuleCollider& b, Contact& contact) {
+		float distanceA = a.normal.dot(b.a) + a.d;
+		float distanceB = a.normal.dot(b.b) + a.d;
+		const vec3& deepest = distanceA < distanceB ? b.a : b.b;
+		float distance = Kore::min(distanceA, distanceB);
+		if (distance > b.radius) return false;
+		
+		contact.normal = a.normal;
+		contact.depth = b.radius - distance;
+		contact.point = deepest - a.normal * distance;
+		return true;
+	}
+	
+	bool generate(const PlaneCollider& a, const AABBCollider& b, Contact& contact) {
+		// The corner of the box furthest behind the plane
+		vec3 corner(a.normal.x() > 0 ? b.min.x() : b.max.x(), a.normal.y() > 0 ? b.min.y() : b.max.y(), a.normal.z() > 0 ? b.min.z() : b.max.z());
+		float distance = a.normal.dot(corner) + a.d;
+		if (distance > 0) return false;
+		
+		contact.normal = a.normal;
+		contact.depth = -distance;
+		contact.point = corner - a.normal * (distance * 0.5f);
+		return true;
+	}
+	
+	bool generate(const CapsuleCollider& a, const CapsuleCollider& b, Contact& contact) {
+		vec3 onA, onB;
+		closestPointsOfSegments(a.a, a.b, b.a, b.b, onA, onB);
+		return contactSpheres(onA, a.radius, onB, b.radius, contact);
+	}
+	
+	bool generate(const CapsuleCollider& a, const AABBCollider& b, Contact& contact) {
+		// Approximate the closest point of the segment by alternating projections, exact for boxes that are not crossed by the segment
+		vec3 center = (b.min + b.max) * 0.5f;
+		vec3 onSegment = closestPointOnSegment(center, a.a, a.b);
+		for (int i = 0; i < 2; ++i) {
+			vec3 onBox(clampf(onSegment.x(), b.min.x(), b.max.x()), clampf(onSegment.y(), b.min.y(), b.max.y()), clampf(onSegment.z(), b.min.z(), b.max.z()));
+			onSegment = closestPointOnSegment(onBox, a.a, a.b);
+		}
+		return contactSphereBox(onSegment, a.radius, b, contact);
+	}
+	
+	bool generate(const AABBCollider& a, const AABBCollider& b, Contact& contact) {
+		// Separate along the axis of the smallest overlap
+		int axis = -1;
+		float depth = FLT_MAX;
+		for (int i = 0; i < 3; ++i) {
+			float overlap = Kore::min(a.max[i], b.max[i]) - Kore::max(a.min[i], b.min[i]);
+			if (overlap < 0) return false;
+			if (overlap < depth) {
+				depth = overlap;
+				axis = i;
+			}
+		}
+		
+		contact.normal = vec3(0, 0, 0);
+		contact.normal[axis] = (b.min[axis] + b.max[axis]) >= (a.min[axis] + a.max[axis]) ? 1.0f : -1.0f;
+		contact.depth = depth;
+		for (int i = 0; i < 3; ++i) {
+			contact.point[i] = (Kore::max(a.min[i], b.min[i]) + Kore::min(a.max[i], b.max[i])) * 0.5f;
+		}
+		return true;
+	}
+	
+	
+	template<ColliderType type> struct ColliderClass;
+	template<> struct ColliderClass<ColliderSphere> { typedef SphereCollider Type; };
+	template<> struct ColliderClass<ColliderPlane> { typedef PlaneCollider Type; };
+	template<> struct ColliderClass<ColliderCapsule> { typedef CapsuleCollider Type; };
+	template<> struct ColliderClass<ColliderAABB> { typedef AABBCollider Type; };
+	
+	// Pairs below the diagonal of the table reuse the function of the swapped pair
+	template<ColliderType A, ColliderType B, bool ordered = (A <= B)> struct Dispatch {
+		static bool Generate(const void* a, const void* b, Contact& result) {
+			return generate(*(const typename ColliderClass<A>::Type*)a, *(const typename ColliderClass<B>::Type*)b, result);
+		}
+	};
+	
+	template<ColliderType A, ColliderType B> struct Dispatch<A, B, false> {
+		static bool Generate(const void* a, const void* b, Contact& result) {
+			if (!Dispatch<B, A>::Generate(b, a, result)) return false;
+			result.normal = result.normal * -1.0f;
+			return true;
+		}
+	};
+	
+	typedef bool (*ContactFunction)(const void* a, const void* b, Contact& result);
+	
+#define CONTACT_ROW(A) { &Dispatch<A, ColliderSphere>::Generate, &Dispatch<A, ColliderPlane>::Generate, &Dispatch<A, ColliderCapsule>::Generate, &Dispatch<A, ColliderAABB>::Generate }
+	
+	const ContactFunction contactTable[ColliderTypeCount][ColliderTypeCount] = {
+		CONTACT_ROW(ColliderSphere),
+		CONTACT_ROW(ColliderPlane),
+		CONTACT_ROW(ColliderCapsule),
+		CONTACT_ROW(ColliderAABB)
+	};
+	
+#undef CONTACT_ROW
+	
+	static_assert(ColliderTypeCount == 4, "Add a row and a column to contactTable for the new type");
+}
+
+bool GenerateContact(const ColliderShape& a, const ColliderShape& b, Contact& contact) {
+	return contactTable[a.type][b.type](a.collider, b.collider, contact);
+}
@@ -2,6 +2,15 @@
 
 #include "pch.h"
 
+// The shapes that contacts can be generated for, the order of the rows and columns of the dispatch table
+enum ColliderType {
+	ColliderSphere,
+	ColliderPlane,
+	ColliderCapsule,
+	ColliderAABB,
+	ColliderTypeCount
+};
+
 // A plane is defined as the plane's normal and the distance of the plane to the origin
 class PlaneCollider {
 public:
@@ -52,3 +61,52 @@ public:
 
 
 };
+
+// A capsule is the set of points within radius of the segment from a to b
+class CapsuleCollider {
+public:
+	Kore::vec3 a;
+	Kore::vec3 b;
+	float radius;
+};
+
+// An axis aligned box
+class AABBCollider {
+public:
+	Kore::vec3 min;
+	Kore::vec3 max;
+};
+
+// The result of one narrowphase test
+struct Contact {
+	// Unit length, pointing from the first shape towards the second one
+	Kore::vec3 normal;
+	// How far the shapes overlap along the normal
+	float depth;
+	// The middle of the overlap
+	Kore::vec3 point;
+};
+
+// The type of each collider class
+template<class T> struct ColliderTraits;
+template<> struct ColliderTraits<SphereCollider> { static const ColliderType type = ColliderSphere; };
+template<> struct ColliderTraits<PlaneCollider> { static const ColliderType type = ColliderPlane; };
+template<> struct ColliderTraits<CapsuleCollider> { static const ColliderType type = ColliderCapsule; };
+template<> struct ColliderTraits<AABBCollider> { static const ColliderType type = ColliderAABB; };
+
+// Refers to a collider of any type
+struct ColliderShape {
+	ColliderType type;
+	const void* collider;
+};
+
+template<class T> ColliderShape MakeShape(const T& collider) {
+	ColliderShape shape;
+	shape.type = ColliderTraits<T>::type;
+	shape.collider = &collider;
+	return shape;
+}
+
+// Test two shapes and compute their contact in one pass, through a table with a function for every pair of types.
+// Returns false when they do not touch, contact is undefined then.
+bool GenerateContact(const ColliderShape& a, const ColliderShape& b, Contact& contact);
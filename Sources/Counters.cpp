@@ -0,0 +1,142 @@
+#include "pch.h"
+
+#include "Counters.h"
+
+#include <Kore/System.h>
+#include <Kore/IO/FileWriter.h>
+#include <Kore/Log.h>
+
+#include <atomic>
+#include <stdio.h>
+#include <assert.h>
+
+using namespace Kore;
+
+namespace {
+	const char* names[] = {
+		"bodies total",
+		"bodies awake",
+		"bodies sleeping",
+		"particles alive",
+		"broadphase pairs",
+		"narrowphase hits",
+		"contacts resolved",
+		"particles spawned",
+		"particles dropped",
+		"draw calls",
+		"state changes",
+		"bytes uploaded",
+		"particle collisions",
+		"spheres tested",
+		"spheres culled",
+		"pipeline changes skipped",
+		"texture changes skipped"
+	};
+	
+	static_assert(sizeof(names) / sizeof(names[0]) == Counters::CounterCount, "Every counter needs a name");
+	
+	const int firstAccumulator = Counters::BroadphasePairs;
+	
+	// Every counter on its own cache line, the simulation and the render thread write concurrently
+	struct alignas(64) Value {
+		std::atomic<int> value;
+	};
+	
+	Value values[Counters::CounterCount];
+	
+	// Ring of sampled frames
+	int window[Counters::windowSize][Counters::CounterCount];
+	int frames = 0;
+	
+	bool overlay = false;
+	double lastOverlay = 0;
+}
+
+void Counters::add(Counter counter, int value) {
+	values[counter].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Counters::set(Counter counter, int value) {
+	values[counter].value.store(value, std::memory_order_relaxed);
+}
+
+void Counters::endFrame() {
+	int* sample = window[frames % windowSize];
+	for (int i = 0; i < CounterCount; ++i) {
+		if (i < firstAccumulator) {
+			sample[i] = values[i].value.load(std::memory_order_relaxed);
+		}
+		else {
+			sample[i] = values[i].value.exchange(0, std::memory_order_relaxed);
+		}
+	}
+	++frames;
+	
+	if (overlay && System::time() - lastOverlay >= 1.0) {
+		lastOverlay = System::time();
+		char line[512];
+		int length = 0;
+		for (int i = 0; i < CounterCount; ++i) {
+			length += snprintf(&line[length], sizeof(line) - length, "%s%s %.1f", i == 0 ? "" : ", ", names[i], average((Counter)i));
+			if (length >= (int)sizeof(line)) break;
+		}
+		log(Info, "%s", line);
+	}
+}
+
+int Counters::get(Counter counter, int framesAgo) {
+	assert(framesAgo >= 0 && framesAgo < windowSize);
+	if (framesAgo >= frames) return 0;
+	return window[(frames - 1 - framesAgo) % windowSize][counter];
+}
+
+float Counters::average(Counter counter) {
+	int count = frames < windowSize ? frames : windowSize;
+	if (count == 0) return 0;
+	
+	double sum = 0;
+	for (int i = 0; i < count; ++i) {
+		sum += window[i][counter];
+	}
+	return (float)(sum / count);
+}
+
+const char* Counters::name(Counter counter) {
+	return names[counter];
+}
+
+void Counters::exportCSV(const char* filename) {
+	FileWriter writer;
+	if (!writer.open(filename)) {
+		log(Warning, "Could not write counters to %s", filename);
+		return;
+	}
+	
+	char line[512];
+	int length = snprintf(line, sizeof(line), "frame");
+	for (int i = 0; i < CounterCount; ++i) {
+		length += snprintf(&line[length], sizeof(line) - length, ",%s", names[i]);
+	}
+	length += snprintf(&line[length], sizeof(line) - length, "\n");
+	writer.write(line, length);
+	
+	int count = frames < windowSize ? frames : windowSize;
+	for (int frame = frames - count; frame < frames; ++frame) {
+		int* sample = window[frame % windowSize];
+		length = snprintf(line, sizeof(line), "%d", frame);
+		for (int i = 0; i < CounterCount; ++i) {
+			length += snprintf(&line[length], sizeof(line) - length, ",%d", sample[i]);
+		}
+		length += snprintf(&line[length], sizeof(line) - length, "\n");
+		writer.write(line, length);
+	}
+	writer.close();
+}
+
+void Counters::setOverlay(bool enabled) {
+	overlay = enabled;
+}
+
+bool Counters::overlayEnabled() {
+	return overlay;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+// Per frame performance counters of the simulation and the renderer.
+// Any thread may add to a counter, the main thread samples all of them into a rolling window once per frame.
+namespace Counters {
+	enum Counter {
+		// Gauges keep their value until they are set again
+		BodiesTotal,
+		BodiesAwake,
+		BodiesSleeping,
+		ParticlesAlive,
+		
+		// Accumulators start from zero every frame
+		BroadphasePairs,
+		NarrowphaseHits,
+		ContactsResolved,
+		ParticlesSpawned,
+		ParticlesDropped,
+		DrawCalls,
+		StateChanges,
+		BytesUploaded,
+		ParticleCollisions,
+		SpheresTested,
+		SpheresCulled,
+		PipelineChangesSkipped,
+		TextureChangesSkipped,
+		
+		CounterCount
+	};
+	
+	// The number of frames kept in the window
+	const int windowSize = 256;
+	
+	void add(Counter counter, int value = 1);
+	
+	void set(Counter counter, int value);
+	
+	// Sample all counters into the window and restart the accumulators
+	void endFrame();
+	
+	// The value of a sampled frame, 0 is the last one
+	int get(Counter counter, int framesAgo = 0);
+	
+	// The average over the sampled frames in the window
+	float average(Counter counter);
+	
+	const char* name(Counter counter);
+	
+	// Write the window as CSV, one line per frame from oldest to newest
+	void exportCSV(const char* filename);
+	
+	// Log the averages once per second
+	void setOverlay(bool enabled);
+	
+	bool overlayEnabled();
+}
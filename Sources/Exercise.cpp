@@ -9,251 +9,27 @@
 #include <Kore/Log.h>
 #include "ObjLoader.h"
 
-#include "Collision.h"
 #include "PhysicsWorld.h"
-#include "PhysicsObject.h"
 #include "Memory.h"
 #include "ShaderProgram.h"
+#include "Jobs.h"
+#include "AssetLoader.h"
+#include "AssetCache.h"
+#include "RenderQueue.h"
+#include "InstancedMesh.h"
+#include "Frustum.h"
+#include "ParticleSystem.h"
+#include "Simulation.h"
+#include "Profiler.h"
+#include "Counters.h"
+#include "QualityGovernor.h"
+#include "Archive.h"
+#include "TaskGraph.h"
 
 using namespace Kore;
 
 namespace {
 
-// A simple particle implementation
-class Particle {
-public:
-	Graphics4::VertexBuffer* vb;
-	Graphics4::IndexBuffer* ib;
-
-	mat4 M;
-	
-	// The current position
-	vec3 position;
-	
-	// The current velocity
-	vec3 velocity;
-
-	// The remaining time to live
-	float timeToLive;
-
-	// The total time time to live
-	float totalTimeToLive;
-
-	// Is the particle dead (= ready to be re-spawned?)
-	bool dead;
-
-	/************************************************************************/
-	/* Solution - Simulate fire by interpolating colors over lifetime       */
-	/************************************************************************/
-	// The beginning color
-	vec4 colorStart;
-
-	// The end color
-	vec4 colorEnd;
-
-	void init(const Graphics4::VertexStructure& structure) {
-		vb = new Graphics4::VertexBuffer(4, structure,0);
-		float* vertices = vb->lock();
-		SetVertex(vertices, 0, -1, -1, 0, 0, 0);
-		SetVertex(vertices, 1, -1, 1, 0, 0, 1);
-		SetVertex(vertices, 2, 1, 1, 0, 1, 1);
-		SetVertex(vertices, 3, 1, -1, 0, 1, 0);
-		vb->unlock();
-
-		// Set index buffer
-		ib = new Graphics4::IndexBuffer(6);
-		int* indices = ib->lock();
-		indices[0] = 0;
-		indices[1] = 1;
-		indices[2] = 2;
-		indices[3] = 0;
-		indices[4] = 2;
-		indices[5] = 3;
-		ib->unlock();
-
-		dead = true;
-	}
-
-
-	void Emit(vec3 pos, vec3 velocity, float timeToLive, vec4 colorStart, vec4 colorEnd) {
-		position = pos;
-		this->velocity = velocity;
-		dead = false;
-		this->timeToLive = timeToLive;
-		totalTimeToLive = timeToLive;
-		this->colorStart = colorStart;
-		this->colorEnd = colorEnd;
-	}
-
-	Particle() {
-	}
-
-
-	void SetVertex(float* vertices, int index, float x, float y, float z, float u, float v) {
-		vertices[index* 8 + 0] = x;
-		vertices[index*8 + 1] = y;
-		vertices[index*8 + 2] = z;
-		vertices[index*8 + 3] = u;
-		vertices[index*8 + 4] = v;
-		vertices[index*8 + 5] = 0.0f;
-		vertices[index*8 + 6] = 0.0f;
-		vertices[index*8 + 7] = -1.0f;
-	}
-
-	void render() {
-		Graphics4::setVertexBuffer(*vb);
-		Graphics4::setIndexBuffer(*ib);
-		Graphics4::drawIndexedVertices();
-	}
-
-	void Integrate(float deltaTime) {
-		timeToLive -= deltaTime;
-
-		if (timeToLive < 0.0f) {
-			dead = true;
-		}
-		
-		// Note: We are using no forces or gravity at the moment.
-
-		position += velocity * deltaTime;
-
-		// Build the matrix
-		M = mat4::Translation(position.x(), position.y(), position.z()) * mat4::Scale(0.2f, 0.2f, 0.2f);
-	}
-
-
-};
-
-
-class ParticleSystem {
-private:
-	ShaderProgram* shaderProgram;
-	
-	Graphics4::Texture* particleImage;
-	
-public:
-
-	// The center of the particle system
-	vec3 position;
-
-	// The minimum coordinates of the emitter box
-	vec3 emitMin;
-
-	// The maximal coordinates of the emitter box
-	vec3 emitMax;
-	
-	// The list of particles
-	Particle* particles;
-
-	// The number of particles
-	int numParticles;
-
-	// The spawn rate
-	float spawnRate;
-	
-	// When should the next particle be spawned?
-	float nextSpawn;
-
-	ParticleSystem(int maxParticles, const Graphics4::VertexStructure& structure, ShaderProgram* shaderProgram) : numParticles(maxParticles), shaderProgram(shaderProgram) {
-		particles = new Particle[maxParticles];
-		for (int i = 0; i < maxParticles; i++) {
-			particles[i].init(structure);
-		}
-		spawnRate = 0.05f;
-		nextSpawn = spawnRate;
-
-		setPosition(vec3(0.5f, 1.3f, 0.5f));
-		
-		particleImage = new Graphics4::Texture("SuperParticle.png");
-	}
-
-	void setPosition(const Kore::vec3& inPosition, float distance = 0.1f)
-	{
-		position = inPosition;
-
-		emitMin = position - vec3(distance, distance, distance);
-		emitMax = position + vec3(distance, distance, distance);
-	}
-
-	
-	void update(float deltaTime) {
-		// Do we need to spawn a particle?
-		nextSpawn -= deltaTime;
-		bool spawnParticle = false;
-		if (nextSpawn < 0) {
-			spawnParticle = true;
-			nextSpawn = spawnRate;
-		}
-		
-		
-		for (int i = 0; i < numParticles; i++) {
-			
-			if (particles[i].dead) {
-				if (spawnParticle) {
-					EmitParticle(i);
-					spawnParticle = false;
-				}
-			}
-
-			particles[i].Integrate(deltaTime);
-		}
-	}
-
-	void render(SceneParameters& parameters) {
-		/************************************************************************/
-		/* Exercise P8.1														*/
-		/************************************************************************/
-		/* Change the matrix V in such a way that the billboards are oriented towards the camera */
-
-		/** This is the alternative solution */
-		/*parameters.V = parameters.V.Invert();
-		parameters.V.Set(0, 3, 0.0f);
-		parameters.V.Set(1, 3, 0.0f);
-		parameters.V.Set(2, 3, 0.0f);*/
-		
-		parameters.V = parameters.V.Transpose3x3();
-
-		/************************************************************************/
-		/* Exercise P8.2														*/
-		/************************************************************************/
-		/* Animate using at least one new control parameter */
-
-		for (int i = 0; i < numParticles; i++) {
-			// Skip dead particles
-			if (particles[i].dead) continue;
-			
-			// Interpolate linearly between the two colors
-			float interpolation = particles[i].timeToLive / particles[i].totalTimeToLive;
-			parameters.tint = particles[i].colorStart * interpolation + particles[i].colorEnd * (1.0f - interpolation);
-			
-			shaderProgram->Set(parameters, particles[i].M * parameters.V, particleImage);
-			
-			particles[i].render();
-		}
-	}
-
-	float getRandom(float minValue, float maxValue) {
-		int randMax = 1000000;
-		int randInt = Random::get(0, randMax);
-		float r =  (float) randInt / (float) randMax;
-		return minValue + r * (maxValue - minValue);
-	}
-
-	void EmitParticle(int index) {
-		// Calculate a random position inside the box
-		float x = getRandom(emitMin.x(), emitMax.x());
-		float y = getRandom(emitMin.y(), emitMax.y());
-		float z = getRandom(emitMin.z(), emitMax.z());
-
-		vec3 pos;
-		pos.set(x, y, z);
-
-		vec3 velocity(0, 0.3f, 0);
-
-		particles[index].Emit(pos, velocity, 3.0f, vec4(2.5f, 0, 0, 1), vec4(0, 0, 0, 0));
-	}
-};
-	
 	const int width = 1024;
 	const int height = 768;
 	
@@ -262,9 +38,6 @@ public:
 	// null terminated array of MeshObject pointers
 	MeshObject* objects[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
 
-	// null terminated array of PhysicsObject pointers
-	PhysicsObject* physicsObjects[] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
-
 	// The view projection matrix aka the camera
 	mat4 P;
 	mat4 V;
@@ -273,26 +46,74 @@ public:
 	vec3 cameraPosition;
 
 	MeshObject* sphere;
-	PhysicsObject* po;
-
-	PhysicsWorld physics;
+	
+	// All spheres are drawn with one instanced draw call
+	InstancedMesh* spheres;
 
 	ParticleSystem* particleSystem;
 	
 	SceneParameters parameters;
+	
+	RenderQueue renderQueue;
+	
+	Frustum frustum;
 
 	double startTime;
 	double lastTime;
-
+	
+	// Time per frame that may be spent creating buffers and textures for loaded assets
+	const double uploadBudget = 0.002;
+	
+	// Lowers particles, simulation rate and detail when frames take too long
+	QualityGovernor governor;
+	
+	// Cull the bodies of the snapshot and queue the visible ones, spheres are drawn instanced
+	void renderBodies(const Simulation::Snapshot& snapshot) {
+		// Cull all bodies at once
+		int numBodies = snapshot.numBodies;
+		float* x = Memory::frameAllocate<float>(numBodies);
+		float* y = Memory::frameAllocate<float>(numBodies);
+		float* z = Memory::frameAllocate<float>(numBodies);
+		float* radius = Memory::frameAllocate<float>(numBodies);
+		unsigned char* visible = Memory::frameAllocate<unsigned char>(numBodies);
+		for (int i = 0; i < numBodies; ++i) {
+			const Simulation::Body& body = snapshot.bodies[i];
+			x[i] = body.position.x();
+			y[i] = body.position.y();
+			z[i] = body.position.z();
+			radius[i] = body.radius;
+		}
+		frustum.cullSpheres(x, y, z, radius, numBodies, visible);
+		
+		spheres->begin(parameters);
+		for (int i = 0; i < numBodies; ++i) {
+			if (!visible[i]) continue;
+			const Simulation::Body& body = snapshot.bodies[i];
+			if (body.mesh == sphere) {
+				spheres->add(body.position, body.scale);
+			}
+			else {
+				body.mesh->M = mat4::Translation(body.position.x(), body.position.y(), body.position.z()) * mat4::Scale(body.scale, body.scale, body.scale);
+				body.mesh->submit(renderQueue, parameters);
+			}
+		}
+		spheres->end();
+		spheres->submit(renderQueue, parameters);
+	}
+	
 	void update() {
 		double t = System::time() - startTime;
 		double deltaT = t - lastTime;
 		//Kore::log(Info, "%f", deltaT);
 		lastTime = t;
 		
+		PROFILE_ZONE("Frame");
+		
 		Graphics4::begin();
 		Graphics4::clear(Graphics4::ClearColorFlag | Graphics4::ClearDepthFlag, 0xff9999FF, 1000.0f);
 		
+		AssetLoader::processUploads(uploadBudget);
+		
 		angle += 0.3f * deltaT;
 
 		float x = 0 + 3 * Kore::cos(angle);
@@ -306,47 +127,49 @@ public:
 		
 		parameters.PV = PV;
 		parameters.V = V;
+		parameters.cameraPosition = cameraPosition;
+		parameters.projectionScale = P.get(1, 1);
+		parameters.lodBias = governor.getSettings().lodBias;
+		
+		frustum.extract(PV);
 
 		// Reset tint for objects that should not be tinted
 		parameters.tint = vec4(1, 1, 1, 1);
 
-		// Iterate the MeshObjects and render them
+		renderQueue.begin();
+		
+		// Iterate the MeshObjects and queue them
 		MeshObject** current = &objects[0];
 		while (*current != nullptr) {
-			(*current)->render(parameters);
+			(*current)->submit(renderQueue, parameters, &frustum);
 			++current;
 		}
 
-		// Update the physics and render the meshes
-		physics.Update(deltaT);
-
-		PhysicsObject** currentP = &physics.physicsObjects[0];
-		while (*currentP != nullptr) {
-			(*currentP)->UpdateMatrix();
-			(*currentP)->Mesh->render(parameters);
-			++currentP;
+		// Physics and particles are simulated on their own thread, render whatever it published last
+		const Simulation::Snapshot& snapshot = Simulation::latest();
+		{
+			PROFILE_ZONE("Render bodies");
+			renderBodies(snapshot);
 		}
+		particleSystem->render(renderQueue, parameters, frustum, snapshot.particles, snapshot.numParticles);
+		
+		// Sorted by state, so pipelines and textures are only changed when needed
+		renderQueue.flush(parameters);
 		
-		particleSystem->update(deltaT);
-		particleSystem->render(parameters);
+		Counters::endFrame();
 
 		Graphics4::end();
+		
+		// Measured before the swap, which waits for the display
+		if (governor.update(System::time() - startTime - t, snapshot.stepTime, snapshot.timeStep)) {
+			Simulation::setQuality(governor.getSettings().simulation);
+			Kore::log(Info, "Quality level %d, average frame time %.1f ms, simulation load %.0f%%", governor.getLevel(), governor.getAverage() * 1000.0, governor.getSimulationLoad() * 100.0);
+		}
+		
+		Memory::endFrame();
 		Graphics4::swapBuffers();
 	}
 
-	void SpawnSphere(vec3 Position, vec3 Velocity) {
-		PhysicsObject* po = new PhysicsObject();
-		po->SetPosition(Position);
-		po->Velocity = Velocity;
-		po->Collider.radius = 0.2f;
-
-		po->Mass = 5;
-		po->Mesh = sphere;
-
-		po->ApplyImpulse(Velocity);
-		physics.AddObject(po);
-	}
-
 	void keyDown(KeyCode code) {
 		if (code == KeySpace) {
 			
@@ -360,7 +183,7 @@ public:
 			vec3 impulse3(impulse.x(), impulse.y(), impulse.z());
 
 			
-			SpawnSphere(cameraPosition + impulse3 *0.2f, impulse3);
+			Simulation::spawnSphere(cameraPosition + impulse3 *0.2f, impulse3, sphere);
 		}
 	}
 
@@ -368,6 +191,19 @@ public:
 		if (code == KeyLeft) {
 			// ...
 		}
+		else if (code == KeyM) {
+			Memory::report();
+			Memory::exportStats("memory.csv");
+		}
+		else if (code == KeyT) {
+			PROFILE_EXPORT("trace.json");
+		}
+		else if (code == KeyC) {
+			Counters::exportCSV("counters.csv");
+		}
+		else if (code == KeyO) {
+			Counters::setOverlay(!Counters::overlayEnabled());
+		}
 	}
 
 	void mouseMove(int windowId, int x, int y, int movementX, int movementY) {
@@ -375,34 +211,211 @@ public:
 	}
 	
 	void mousePress(int windowId, int button, int x, int y) {
-
+		// Unproject the cursor onto the near and the far plane
+		float screenX = 2.0f * x / width - 1.0f;
+		float screenY = 1.0f - 2.0f * y / height;
+		mat4 PVI = PV.Invert();
+		vec4 nearPoint = PVI * vec4(screenX, screenY, -1.0f, 1.0f);
+		vec4 farPoint = PVI * vec4(screenX, screenY, 1.0f, 1.0f);
+		vec3 start(nearPoint.x() / nearPoint.w(), nearPoint.y() / nearPoint.w(), nearPoint.z() / nearPoint.w());
+		vec3 end(farPoint.x() / farPoint.w(), farPoint.y() / farPoint.w(), farPoint.z() / farPoint.w());
+		
+		vec3 direction = end - start;
+		float maxDistance = direction.getLength();
+		
+		// Kick the picked body away from the camera, the simulation traces the ray through its regions
+		vec3 impulse = direction;
+		impulse.normalize();
+		Simulation::applyImpulseToHit(start, direction, maxDistance, impulse * 3.0f + vec3(0, 2.0f, 0));
 	}
 
 	void mouseRelease(int windowId, int button, int x, int y) {
 		
 	}
 
+	// The startup is a TaskGraph: Files are decoded on the workers while the shaders are compiled,
+	// everything that creates GPU resources runs on the main thread as soon as its inputs are ready.
+	
+	// This defines the structure of your Vertex Buffer
+	Graphics4::VertexStructure structure;
+	
+	struct MeshLoad {
+		const char* filename;
+		const char* decodeName;
+		const char* uploadName;
+		Graphics4::VertexStructure* structure;
+		Mesh* mesh;
+		// The reference of the load, released once the objects have taken theirs
+		MeshHandle* handle;
+	};
+	
+	struct TextureLoad {
+		const char* filename;
+		const char* decodeName;
+		const char* uploadName;
+		AssetLoader::DecodedTexture texture;
+		TextureHandle* handle;
+	};
+	
+	struct ProgramLoad {
+		const char* name;
+		const char* vsFile;
+		const char* fsFile;
+		Graphics4::VertexStructure* structure;
+		bool depthWrite;
+		Graphics4::VertexStructure* instanceStructure;
+		ShaderProgram* program;
+	};
+	
+	MeshLoad baseMesh = { "Base.obj", "Decode Base.obj", "Upload Base.obj", nullptr, nullptr };
+	MeshLoad ballMesh = { "ball_at_origin.obj", "Decode ball_at_origin.obj", "Upload ball_at_origin.obj", &structure, nullptr };
+	TextureLoad baseTexture = { "Level/basicTiles6x6.png", "Decode basicTiles6x6.png", "Upload basicTiles6x6.png" };
+	TextureLoad ballTexture = { "Level/unshaded.png", "Decode unshaded.png", "Upload unshaded.png" };
+	TextureLoad particleTexture = { "SuperParticle.png", "Decode SuperParticle.png", "Upload SuperParticle.png" };
+	
+	ProgramLoad shader = { "Compile shader", "shader.vert", "shader.frag", &structure, true, nullptr };
+	ProgramLoad shaderParticle = { "Compile shader_particle", "shader_particle.vert", "shader_particle.frag", &structure, false, nullptr };
+	ProgramLoad shaderCompressed = { "Compile shader_compressed", "shader_compressed.vert", "shader.frag", nullptr, true, nullptr };
+	ProgramLoad shaderInstanced = { "Compile shader_instanced", "shader_instanced.vert", "shader.frag", &structure, true, nullptr };
+	
+	void decodeMesh(void* param) {
+		MeshLoad* load = (MeshLoad*)param;
+		load->mesh = AssetLoader::decodeMesh(load->filename);
+	}
+	
+	void uploadMesh(void* param) {
+		MeshLoad* load = (MeshLoad*)param;
+		MeshHandle* handle = new MeshHandle;
+		AssetLoader::uploadMesh(handle, load->mesh, *load->structure, 1.0f);
+		load->handle = AssetCache::addMesh(load->filename, *load->structure, 1.0f, handle);
+	}
+	
+	void decodeTexture(void* param) {
+		TextureLoad* load = (TextureLoad*)param;
+		load->texture = AssetLoader::decodeTexture(load->filename);
+	}
+	
+	void uploadTexture(void* param) {
+		TextureLoad* load = (TextureLoad*)param;
+		TextureHandle* handle = new TextureHandle;
+		AssetLoader::uploadTexture(handle, load->texture);
+		load->handle = AssetCache::addTexture(load->filename, handle);
+	}
+	
+	void compileProgram(void* param) {
+		ProgramLoad* load = (ProgramLoad*)param;
+		load->program = AssetCache::getShaderProgram(load->vsFile, load->fsFile, *load->structure, load->depthWrite, load->instanceStructure);
+	}
+	
+	void createObjects(void*) {
+		// The meshes and textures are in the cache already
+		objects[0] = AssetCache::createMeshObject(baseMesh.filename, baseTexture.filename, AssetLoader::compressedStructure(), shaderCompressed.program);
+		objects[0]->M = mat4::Translation(0.0f, 1.0f, 0.0f);
+
+		sphere = AssetCache::createMeshObject(ballMesh.filename, ballTexture.filename, structure, shader.program);
+		spheres = new InstancedMesh(sphere, shaderInstanced.program, PhysicsWorld::maxObjects);
+		
+		// The objects hold their own references now
+		AssetCache::release(baseMesh.handle);
+		AssetCache::release(ballMesh.handle);
+		AssetCache::release(baseTexture.handle);
+		AssetCache::release(ballTexture.handle);
+	}
+	
+	void createParticles(void*) {
+		// All emitters share one pool of particles
+		particleSystem = new ParticleSystem(1024, 64, structure, shaderParticle.program);
+		particleSystem->collisions.enabled = true;
+		
+		TextureHandle* particleImage = AssetCache::getTexture(particleTexture.filename);
+		particleSystem->addEmitter(vec3(0.5f, 1.3f, 0.5f), particleImage);
+		
+		// A ring of small torches
+		for (int i = 0; i < 16; ++i) {
+			float torchAngle = i * 2.0f * pi / 16;
+			int torch = particleSystem->addEmitter(vec3(2.0f * Kore::cos(torchAngle), 1.1f, 2.0f * Kore::sin(torchAngle)), particleImage);
+			ParticleEmitter& emitter = particleSystem->emitters[torch];
+			emitter.spawnRate = 0.1f;
+			emitter.lifetime = 1.5f;
+			emitter.budget = 20;
+			emitter.colorStart = vec4(2.5f, 1.2f, 0.2f, 1);
+		}
+		
+		AssetCache::release(particleTexture.handle);
+	}
+	
+	void startSimulation(void*) {
+		Simulation::init(particleSystem);
+		Simulation::spawnSphere(vec3(0, 2, 0), vec3(0, 0, 0), sphere);
+		Simulation::start();
+	}
+	
+	// Adds the decode and the upload, returns the upload
+	int addLoad(TaskGraph& graph, MeshLoad& load) {
+		int decode = graph.add(load.decodeName, TaskGraph::Worker, decodeMesh, &load);
+		int upload = graph.add(load.uploadName, TaskGraph::Main, uploadMesh, &load);
+		graph.depend(upload, decode);
+		return upload;
+	}
+	
+	int addLoad(TaskGraph& graph, TextureLoad& load) {
+		int decode = graph.add(load.decodeName, TaskGraph::Worker, decodeTexture, &load);
+		int upload = graph.add(load.uploadName, TaskGraph::Main, uploadTexture, &load);
+		graph.depend(upload, decode);
+		return upload;
+	}
+
 	void init() {
 		Memory::init();
+		PROFILE_THREAD("Main");
+		
+		// Packed by Tools/Packer, the files are read one by one when there is no archive
+		Archive::open("assets.pak");
+		
+		Jobs::init();
+		AssetLoader::init();
 		
-		// This defines the structure of your Vertex Buffer
-		Graphics4::VertexStructure structure;
 		structure.add("pos", Graphics4::Float3VertexData);
 		structure.add("tex", Graphics4::Float2VertexData);
 		structure.add("nor", Graphics4::Float3VertexData);
-
-		// Set up shader
-		ShaderProgram* shader = new ShaderProgram("shader.vert", "shader.frag", structure, true);
-		ShaderProgram* shaderParticle = new ShaderProgram("shader.vert", "shader.frag", structure, false);
 		
-		objects[0] = new MeshObject("Base.obj", "Level/basicTiles6x6.png", structure, shader);
-		objects[0]->M = mat4::Translation(0.0f, 1.0f, 0.0f);
-
-		sphere = new MeshObject("ball_at_origin.obj", "Level/unshaded.png", structure, shader);
-
-		SpawnSphere(vec3(0, 2, 0), vec3(0, 0, 0));
+		baseMesh.structure = &AssetLoader::compressedStructure();
+		shaderCompressed.structure = &AssetLoader::compressedStructure();
+		shaderParticle.instanceStructure = &ParticleSystem::instanceStructure();
+		shaderInstanced.instanceStructure = &InstancedMesh::instanceStructure();
+		
+		// The decodes of all loads run on the workers at the same time
+		TaskGraph startup;
+		int baseMeshUpload = addLoad(startup, baseMesh);
+		int ballMeshUpload = addLoad(startup, ballMesh);
+		int baseTextureUpload = addLoad(startup, baseTexture);
+		int ballTextureUpload = addLoad(startup, ballTexture);
+		int particleTextureUpload = addLoad(startup, particleTexture);
+		
+		int compileShader = startup.add(shader.name, TaskGraph::Main, compileProgram, &shader);
+		int compileParticle = startup.add(shaderParticle.name, TaskGraph::Main, compileProgram, &shaderParticle);
+		int compileCompressed = startup.add(shaderCompressed.name, TaskGraph::Main, compileProgram, &shaderCompressed);
+		int compileInstanced = startup.add(shaderInstanced.name, TaskGraph::Main, compileProgram, &shaderInstanced);
+		
+		int objectsCreated = startup.add("Create objects", TaskGraph::Main, createObjects);
+		startup.depend(objectsCreated, baseMeshUpload);
+		startup.depend(objectsCreated, baseTextureUpload);
+		startup.depend(objectsCreated, ballMeshUpload);
+		startup.depend(objectsCreated, ballTextureUpload);
+		startup.depend(objectsCreated, compileShader);
+		startup.depend(objectsCreated, compileCompressed);
+		startup.depend(objectsCreated, compileInstanced);
+		
+		int particlesCreated = startup.add("Create particles", TaskGraph::Main, createParticles);
+		startup.depend(particlesCreated, particleTextureUpload);
+		startup.depend(particlesCreated, compileParticle);
+		
+		int simulationStarted = startup.add("Start simulation", TaskGraph::Main, startSimulation);
+		startup.depend(simulationStarted, objectsCreated);
+		startup.depend(simulationStarted, particlesCreated);
 		
-		particleSystem = new ParticleSystem(100, structure, shaderParticle);
+		startup.run();
+		startup.report();
 	}
 }
 
@@ -0,0 +1,88 @@
+#include "pch.h"
+
+#include "Frustum.h"
+#include "Counters.h"
+
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE
+#endif
+
+void Frustum::extract(const mat4& PV) {
+	// Gribb/Hartmann: left/right = row3 +/- row0, bottom/top = row3 +/- row1, near/far = row3 +/- row2
+	for (int i = 0; i < 6; ++i) {
+		int row = i / 2;
+		float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+		for (int column = 0; column < 4; ++column) {
+			planes[i][column] = PV.get(3, column) + sign * PV.get(row, column);
+		}
+		float length = sqrtf(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+		for (int column = 0; column < 4; ++column) {
+			planes[i][column] /= length;
+		}
+	}
+	
+	stats.tested = 0;
+	stats.culled = 0;
+}
+
+bool Frustum::isVisible(const vec3& center, float radius) {
+	++stats.tested;
+	Counters::add(Counters::SpheresTested);
+	for (int i = 0; i < 6; ++i) {
+		float distance = planes[i][0] * center.x() + planes[i][1] * center.y() + planes[i][2] * center.z() + planes[i][3];
+		if (distance < -radius) {
+			++stats.culled;
+			Counters::add(Counters::SpheresCulled);
+			return false;
+		}
+	}
+	return true;
+}
+
+void Frustum::cullSpheres(const float* x, const float* y, const float* z, const float* radius, int count, unsigned char* visible) {
+	int i = 0;
+	int culled = 0;
+	
+#ifdef FRUSTUM_SSE
+	for (; i + 4 <= count; i += 4) {
+		__m128 px = _mm_loadu_ps(&x[i]);
+		__m128 py = _mm_loadu_ps(&y[i]);
+		__m128 pz = _mm_loadu_ps(&z[i]);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+		
+		// Bit j is set when sphere j is completely behind any plane
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; ++p) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(planes[p][0])), _mm_mul_ps(py, _mm_set1_ps(planes[p][1]))),
+			                             _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(planes[p][2])), _mm_set1_ps(planes[p][3])));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+		}
+		int mask = _mm_movemask_ps(outside);
+		
+		for (int j = 0; j < 4; ++j) {
+			visible[i + j] = (mask & (1 << j)) == 0 ? 1 : 0;
+		}
+		culled += ((mask >> 0) & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+	}
+#endif
+	
+	for (; i < count; ++i) {
+		visible[i] = 1;
+		for (int p = 0; p < 6; ++p) {
+			float distance = planes[p][0] * x[i] + planes[p][1] * y[i] + planes[p][2] * z[i] + planes[p][3];
+			if (distance < -radius[i]) {
+				visible[i] = 0;
+				++culled;
+				break;
+			}
+		}
+	}
+	
+	stats.tested += count;
+	stats.culled += culled;
+	Counters::add(Counters::SpheresTested, count);
+	Counters::add(Counters::SpheresCulled, culled);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "pch.h"
+
+using namespace Kore;
+
+// The six planes of a view frustum, for culling bounding spheres.
+class Frustum {
+public:
+	struct Stats {
+		int tested;
+		int culled;
+	};
+	
+	// Extract the planes from a projection * view matrix. Resets the statistics.
+	void extract(const mat4& PV);
+	
+	// True if the sphere is at least partially inside
+	bool isVisible(const vec3& center, float radius);
+	
+	// Test count spheres at once (4 per step where SSE is available), writes 1 for visible and 0 for culled spheres to visible
+	void cullSpheres(const float* x, const float* y, const float* z, const float* radius, int count, unsigned char* visible);
+	
+	// The spheres tested since the last extract
+	const Stats& getStats() const {
+		return stats;
+	}
+	
+private:
+	// Plane i is planes[i][0..2] * p + planes[i][3] >= 0 for points inside, the normal has unit length
+	float planes[6][4];
+	
+	Stats stats;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "pch.h"
+
+#include <Kore/Graphics4/Graphics.h>
+#include <assert.h>
+#include <float.h>
+
+#include "MeshObject.h"
+#include "RenderQueue.h"
+#include "Counters.h"
+
+using namespace Kore;
+
+// Draws many copies of a mesh with one instanced draw call.
+// Every instance has a position and a uniform scale, which are written into a per instance vertex buffer each frame.
+// Needs a ShaderProgram that was created with instanceStructure() (e.g. shader_instanced.vert).
+// The whole batch is drawn with the level of detail of the instance that is largest on screen.
+class InstancedMesh {
+public:
+	InstancedMesh(MeshObject* meshObject, ShaderProgram* shaderProgram, int maxInstances) : meshObject(meshObject), shaderProgram(shaderProgram), maxInstances(maxInstances), count(0), data(nullptr), largestSize(0), largestScale(0) {
+		instanceBuffer = new Graphics4::VertexBuffer(maxInstances, instanceStructure(), 1);
+	}
+	
+	// The per instance vertex data: position in xyz, scale in w
+	static Graphics4::VertexStructure& instanceStructure() {
+		static Graphics4::VertexStructure structure;
+		static bool initialized = false;
+		if (!initialized) {
+			structure.add("instance", Graphics4::Float4VertexData);
+			structure.instanced = true;
+			initialized = true;
+		}
+		return structure;
+	}
+	
+	// Start writing the instances of this frame, the camera is needed to find the instance that is largest on screen
+	void begin(const SceneParameters& parameters) {
+		count = 0;
+		data = instanceBuffer->lock();
+		cameraPosition = parameters.cameraPosition;
+		largestSize = 0;
+		largestScale = 0;
+	}
+	
+	void add(const vec3& position, float scale) {
+		assert(count < maxInstances);
+		if (count >= maxInstances) return;
+		
+		float* instance = &data[count * 4];
+		instance[0] = position.x();
+		instance[1] = position.y();
+		instance[2] = position.z();
+		instance[3] = scale;
+		++count;
+		
+		// Scale over distance is proportional to the size on screen because all instances share one mesh
+		float distance = (position - cameraPosition).getLength();
+		float size = distance > 0 ? scale / distance : FLT_MAX;
+		if (size > largestSize) {
+			largestSize = size;
+			largestPosition = position;
+			largestScale = scale;
+		}
+	}
+	
+	void end() {
+		instanceBuffer->unlock();
+		Counters::add(Counters::BytesUploaded, count * 4 * sizeof(float));
+		data = nullptr;
+	}
+	
+	// Queue one draw for all instances
+	void submit(RenderQueue& queue, const SceneParameters& parameters) {
+		if (!meshObject->isReady()) return;
+		
+		if (count == 0) return;
+		
+		MeshHandle* mesh = meshObject->getMesh();
+		Mesh* data = mesh->mesh;
+		float scale = mesh->scale * largestScale;
+		vec3 center = largestPosition + vec3(data->boundsCenter[0], data->boundsCenter[1], data->boundsCenter[2]) * scale;
+		float radius = data->boundsRadius * scale;
+		queue.submitInstanced(shaderProgram, meshObject->getTexture()->texture, mesh->vertexBuffer, meshObject->selectLod(parameters, center, radius), instanceBuffer, count, mat4::Identity(), parameters.tint, 0.0f);
+	}
+	
+	int getCount() const {
+		return count;
+	}
+	
+private:
+	MeshObject* meshObject;
+	ShaderProgram* shaderProgram;
+	
+	Graphics4::VertexBuffer* instanceBuffer;
+	int maxInstances;
+	int count;
+	float* data;
+	
+	vec3 cameraPosition;
+	vec3 largestPosition;
+	float largestSize;
+	float largestScale;
+};
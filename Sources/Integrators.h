@@ -0,0 +1,68 @@
+#pragma once
+
+#include "pch.h"
+
+#include <math.h>
+
+// Integration policies for PhysicsObject::Integrate. The acceleration is constant during a step.
+// Step advances position and velocity by deltaT.
+
+// The scheme of the original exercise: the position is moved with the old velocity.
+// Only first order accurate and it gains energy, so it needs small steps and damping.
+struct ExplicitEuler {
+	static void Step(Kore::vec3& position, Kore::vec3& velocity, const Kore::vec3& acceleration, float deltaT) {
+		position += velocity * deltaT;
+		velocity += acceleration * deltaT;
+	}
+};
+
+// Updates the velocity first and moves with the new one. As cheap as explicit Euler but keeps the energy bounded.
+struct SymplecticEuler {
+	static void Step(Kore::vec3& position, Kore::vec3& velocity, const Kore::vec3& acceleration, float deltaT) {
+		velocity += acceleration * deltaT;
+		position += velocity * deltaT;
+	}
+};
+
+// Verlet in velocity form, second order accurate. Keeping the velocity instead of the previous position
+// lets collision impulses change it directly.
+struct Verlet {
+	static void Step(Kore::vec3& position, Kore::vec3& velocity, const Kore::vec3& acceleration, float deltaT) {
+		position += velocity * deltaT + acceleration * (0.5f * deltaT * deltaT);
+		velocity += acceleration * deltaT;
+	}
+};
+
+// Second order Runge-Kutta: moves with the velocity at the middle of the step
+struct Midpoint {
+	static void Step(Kore::vec3& position, Kore::vec3& velocity, const Kore::vec3& acceleration, float deltaT) {
+		Kore::vec3 halfVelocity = velocity + acceleration * (0.5f * deltaT);
+		position += halfVelocity * deltaT;
+		velocity += acceleration * deltaT;
+	}
+};
+
+
+// Damping policies, Factor is multiplied into the velocity after each step
+
+struct NoDamping {
+	static float Factor(float deltaT) {
+		return 1.0f;
+	}
+};
+
+// The same factor for every step, so the damping depends on the step rate
+struct PerStepDamping {
+	static float Factor(float deltaT) {
+		return 0.98f;
+	}
+};
+
+// Decays the velocity by the same amount per second at any step rate, 0.98 per step at 60 steps per second
+struct ExponentialDamping {
+	static float Factor(float deltaT) {
+		// -ln(0.98) * 60
+		const float rate = 1.2121623f;
+		return expf(-rate * deltaT);
+	}
+};
@@ -0,0 +1,148 @@
+#include "pch.h"
+
+#include "Jobs.h"
+#include "Profiler.h"
+
+#include <Kore/Threads/Thread.h>
+#include <Kore/Threads/Mutex.h>
+#include <Kore/Threads/Semaphore.h>
+#include <assert.h>
+
+#include <atomic>
+
+using namespace Kore;
+
+namespace {
+	const int maxJobs = 1024;
+	
+	struct Job {
+		Jobs::JobFunction function;
+		void* param;
+	};
+	
+	// Ring buffer of queued jobs, protected by mutex
+	Job jobs[maxJobs];
+	int first = 0;
+	int count = 0;
+	Mutex mutex;
+	
+	// Counts the queued jobs, the workers sleep on it
+	Semaphore available;
+	
+	int threads = 0;
+	
+	// Shared by the thread calling parallelFor and the workers helping it.
+	// Helpers may only start after the call returned, so the last one to leave deletes it.
+	struct ParallelFor {
+		Jobs::RangeFunction function;
+		void* param;
+		int count;
+		int chunkSize;
+		std::atomic<int> next;
+		std::atomic<int> done;
+		std::atomic<int> references;
+	};
+	
+	void runChunks(ParallelFor* work) {
+		for (;;) {
+			int start = work->next.fetch_add(work->chunkSize);
+			if (start >= work->count) return;
+			int end = start + work->chunkSize < work->count ? start + work->chunkSize : work->count;
+			work->function(start, end, work->param);
+			work->done.fetch_add(end - start, std::memory_order_release);
+		}
+	}
+	
+	// Helpers that were queued and did not finish yet, no more than one per worker are queued
+	std::atomic<int> helping(0);
+	
+	void release(ParallelFor* work) {
+		if (work->references.fetch_sub(1) == 1) {
+			delete work;
+		}
+	}
+	
+	void helpParallelFor(void* param) {
+		ParallelFor* work = (ParallelFor*)param;
+		runChunks(work);
+		release(work);
+		helping.fetch_sub(1);
+	}
+	
+	void worker(void*) {
+		PROFILE_THREAD("Worker");
+		
+		for (;;) {
+			available.acquire();
+			
+			mutex.Lock();
+			Job job = jobs[first];
+			first = (first + 1) % maxJobs;
+			--count;
+			mutex.Unlock();
+			
+			job.function(job.param);
+		}
+	}
+}
+
+void Jobs::init(int threadCount) {
+	threadsInit();
+	mutex.Create();
+	available.create(0, maxJobs);
+	threads = threadCount;
+	for (int i = 0; i < threadCount; ++i) {
+		createAndRunThread(worker, nullptr);
+	}
+}
+
+void Jobs::add(JobFunction function, void* param) {
+	mutex.Lock();
+	assert(count < maxJobs);
+	Job& job = jobs[(first + count) % maxJobs];
+	job.function = function;
+	job.param = param;
+	++count;
+	mutex.Unlock();
+	
+	available.release();
+}
+
+void Jobs::parallelFor(int count, int chunkSize, RangeFunction function, void* param) {
+	if (count <= chunkSize || threads == 0) {
+		if (count > 0) function(0, count, param);
+		return;
+	}
+	
+	int chunks = (count + chunkSize - 1) / chunkSize;
+	int helpers = chunks - 1 < threads ? chunks - 1 : threads;
+	int idle = threads - helping.fetch_add(helpers);
+	if (idle < helpers) {
+		helping.fetch_sub(helpers - (idle > 0 ? idle : 0));
+		helpers = idle > 0 ? idle : 0;
+	}
+	
+	ParallelFor* work = new ParallelFor;
+	work->function = function;
+	work->param = param;
+	work->count = count;
+	work->chunkSize = chunkSize;
+	work->next = 0;
+	work->done = 0;
+	work->references = helpers + 1;
+	for (int i = 0; i < helpers; ++i) {
+		add(helpParallelFor, work);
+	}
+	
+	runChunks(work);
+	
+	// Chunks that were taken by a worker are being worked on, they finish soon
+	while (work->done.load(std::memory_order_acquire) < count) {
+		threadSleep(0);
+	}
+	release(work);
+}
+
+int Jobs::threadCount() {
+	return threads;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// A small pool of worker threads that runs queued jobs in FIFO order.
+namespace Jobs {
+	typedef void (*JobFunction)(void* param);
+	typedef void (*RangeFunction)(int start, int end, void* param);
+	
+	// Start the worker threads
+	void init(int threadCount = 3);
+	
+	// Queue a job to be run on one of the worker threads
+	void add(JobFunction function, void* param);
+	
+	// Run function over [0, count) in chunks and return when all are done.
+	// The calling thread works on the chunks too, so this also finishes when the workers are busy with other jobs.
+	void parallelFor(int count, int chunkSize, RangeFunction function, void* param);
+	
+	int threadCount();
+}
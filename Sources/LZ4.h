@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// The LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), used for compressed archive entries.
+// Compression is a simple greedy matcher for the packer, decompression is fast enough to run while loading.
+namespace LZ4 {
+	// The largest possible size of count bytes after compression
+	inline int compressBound(int count) {
+		return count + count / 255 + 16;
+	}
+	
+	inline uint32_t read32(const uint8_t* data) {
+		uint32_t value;
+		memcpy(&value, data, 4);
+		return value;
+	}
+	
+	inline uint8_t* writeLength(uint8_t* target, int length) {
+		while (length >= 255) {
+			*target++ = 255;
+			length -= 255;
+		}
+		*target++ = (uint8_t)length;
+		return target;
+	}
+	
+	// Compress count bytes of source into target, which needs room for compressBound(count) bytes. Returns the compressed size.
+	// table needs room for 1 << 16 ints and is only used while compressing.
+	inline int compress(const uint8_t* source, int count, uint8_t* target, int* table) {
+		const int hashBits = 16;
+		for (int i = 0; i < 1 << hashBits; ++i) {
+			table[i] = -1;
+		}
+		
+		// The last match has to start 12 bytes before the end and the last 5 bytes are always literals
+		const int matchStartLimit = count - 12;
+		const int matchEndLimit = count - 5;
+		
+		uint8_t* output = target;
+		int anchor = 0;
+		int position = 0;
+		while (position <= matchStartLimit) {
+			uint32_t sequence = read32(&source[position]);
+			uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+			int candidate = table[hash];
+			table[hash] = position;
+			if (candidate < 0 || position - candidate > 65535 || read32(&source[candidate]) != sequence) {
+				++position;
+				continue;
+			}
+			
+			int length = 4;
+			while (position + length < matchEndLimit && source[candidate + length] == source[position + length]) {
+				++length;
+			}
+			
+			// The literals since the last match, then the match
+			int literals = position - anchor;
+			uint8_t* token = output++;
+			*token = (uint8_t)((literals < 15 ? literals : 15) << 4);
+			if (literals >= 15) output = writeLength(output, literals - 15);
+			memcpy(output, &source[anchor], literals);
+			output += literals;
+			
+			int offset = position - candidate;
+			*output++ = (uint8_t)(offset & 0xff);
+			*output++ = (uint8_t)(offset >> 8);
+			
+			int matchLength = length - 4;
+			*token |= (uint8_t)(matchLength < 15 ? matchLength : 15);
+			if (matchLength >= 15) output = writeLength(output, matchLength - 15);
+			
+			position += length;
+			anchor = position;
+		}
+		
+		// The rest are literals
+		int literals = count - anchor;
+		*output++ = (uint8_t)((literals < 15 ? literals : 15) << 4);
+		if (literals >= 15) output = writeLength(output, literals - 15);
+		memcpy(output, &source[anchor], literals);
+		output += literals;
+		
+		return (int)(output - target);
+	}
+	
+	// Decompress count bytes of source into target, which has room for capacity bytes.
+	// Returns the decompressed size or -1 when source is corrupt.
+	inline int decompress(const uint8_t* source, int count, uint8_t* target, int capacity) {
+		const uint8_t* input = source;
+		const uint8_t* inputEnd = source + count;
+		uint8_t* output = target;
+		uint8_t* outputEnd = target + capacity;
+		
+		while (input < inputEnd) {
+			unsigned token = *input++;
+			
+			size_t literals = token >> 4;
+			if (literals == 15) {
+				unsigned add;
+				do {
+					if (input >= inputEnd) return -1;
+					add = *input++;
+					literals += add;
+				} while (add == 255);
+			}
+			if (literals > (size_t)(inputEnd - input) || literals > (size_t)(outputEnd - output)) return -1;
+			memcpy(output, input, literals);
+			output += literals;
+			input += literals;
+			
+			// The last sequence has no match
+			if (input == inputEnd) break;
+			
+			if (inputEnd - input < 2) return -1;
+			size_t offset = input[0] | (input[1] << 8);
+			input += 2;
+			if (offset == 0 || offset > (size_t)(output - target)) return -1;
+			
+			size_t length = token & 15;
+			if (length == 15) {
+				unsigned add;
+				do {
+					if (input >= inputEnd) return -1;
+					add = *input++;
+					length += add;
+				} while (add == 255);
+			}
+			length += 4;
+			if (length > (size_t)(outputEnd - output)) return -1;
+			
+			// Matches may overlap the bytes they produce
+			const uint8_t* match = output - offset;
+			for (size_t i = 0; i < length; ++i) {
+				output[i] = match[i];
+			}
+			output += length;
+		}
+		return (int)(output - target);
+	}
+}
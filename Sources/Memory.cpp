@@ -2,30 +2,369 @@
 
 #include "Memory.h"
 
+#include <Kore/Threads/Mutex.h>
+#include <Kore/IO/FileWriter.h>
+#include <Kore/Log.h>
 #include <assert.h>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define VIRTUAL_MEMORY
+#elif (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#include <sys/mman.h>
+#define VIRTUAL_MEMORY
+#endif
 
 using namespace Kore;
 
 namespace {
-	const size_t memorySize = 10 * 1024 * 1024;
-	const size_t scratchPadSize = 4 * 1024 * 1024;
+	// The main thread uses the start of the memory block as its arena, the other threads allocate theirs on first use
+	const size_t mainArenaSize = 16 * 1024 * 1024;
+	const size_t threadArenaSize = 16 * 1024 * 1024;
+	
+	const size_t frameArenaSize = 512 * 1024;
+	
+#ifdef VIRTUAL_MEMORY
+	// Address space is reserved up front and committed when it is first used.
+	// Memory never moves, so pointers into it stay valid while it grows.
+	// 16 GB on 64 bit systems, 512 MB on 32 bit systems
+	const size_t memorySize = (size_t)1 << (sizeof(void*) == 8 ? 34 : 29);
+#if defined(MEMORY_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+	// Commit in huge page sized steps so the kernel can back them with transparent huge pages
+	const size_t commitSize = 2 * 1024 * 1024;
+#else
+	const size_t commitSize = 64 * 1024;
+#endif
+#else
+	// Without virtual memory everything is allocated up front: the arenas of the main thread,
+	// the Jobs workers and the simulation thread, the frame arenas and the heap for the assets
+	const int fallbackThreadArenas = 4;
+	const size_t fallbackHeapSize = 32 * 1024 * 1024;
+	const size_t memorySize = mainArenaSize + fallbackThreadArenas * threadArenaSize + 2 * frameArenaSize + fallbackHeapSize;
+#endif
+	
+	// Memory::init places the main arena and the frame arenas at the start of the block
+	static_assert(mainArenaSize + 2 * frameArenaSize < memorySize, "The memory block is smaller than the arenas");
+	
+	const char* tagNames[] = { "general", "mesh", "physics", "particles", "scratch", "frame" };
+	
 	u8* memory;
-	size_t index;
+	size_t memoryIndex;
+	size_t committed;
+	
+	// allocate is called from the asset loading threads, too
+	Mutex allocationMutex;
+	
+	Memory::StackAllocator mainArena;
+	thread_local Memory::StackAllocator* currentArena = nullptr;
+	
+	// All thread arenas, for the statistics
+	const int maxArenas = 64;
+	Memory::StackAllocator* arenas[maxArenas];
+	int numArenas = 0;
+	
+	// Two frame arenas, one is written in the current frame while the other one still holds the data of the last frame
+	u8* frameArenas[2];
+	std::atomic<size_t> frameTop;
+	int currentFrameArena;
+	size_t frameHighWater;
+	size_t frameOverflows;
+	size_t frameOverflowsLogged;
+	
+	// Protected by allocationMutex
+	Memory::TagStats tagStats[Memory::TagCount];
+	
+#ifdef MEMORY_DEBUG
+	const size_t guardSize = 16;
+	const u8 guardValue = 0xfd;
+	
+	struct GuardedAllocation {
+		u8* data;
+		size_t size;
+		Memory::Tag tag;
+	};
+	
+	// Protected by allocationMutex
+	const int maxGuarded = 16 * 1024;
+	GuardedAllocation guarded[maxGuarded];
+	int numGuarded = 0;
+	
+	// The end of the last scratch pad request of this thread
+	thread_local u8* scratchGuard = nullptr;
+	
+	void writeGuard(u8* data) {
+		memset(data, guardValue, guardSize);
+	}
+	
+	bool guardIntact(const u8* data) {
+		for (size_t i = 0; i < guardSize; ++i) {
+			if (data[i] != guardValue) return false;
+		}
+		return true;
+	}
+	
+	// The last scratch pad user of this thread must not have written past the size it requested
+	void checkScratchGuard() {
+		if (scratchGuard != nullptr && !guardIntact(scratchGuard)) {
+			log(Error, "Scratch pad overflow");
+			assert(false);
+		}
+		scratchGuard = nullptr;
+	}
+#endif
+	
+	size_t alignUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+	
+	void reserve() {
+#if defined(_WIN32)
+		memory = (u8*)VirtualAlloc(nullptr, memorySize, MEM_RESERVE, PAGE_NOACCESS);
+#elif defined(VIRTUAL_MEMORY)
+		void* data = mmap(nullptr, memorySize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		memory = data == MAP_FAILED ? nullptr : (u8*)data;
+#if defined(MEMORY_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+		if (memory != nullptr) madvise(memory, memorySize, MADV_HUGEPAGE);
+#endif
+#else
+		memory = new u8[memorySize];
+#endif
+		if (memory == nullptr) {
+			log(Error, "Could not reserve %llu bytes of memory", (unsigned long long)memorySize);
+			abort();
+		}
+		committed = 0;
+	}
+	
+	// Make sure the first size bytes are usable
+	void commit(size_t size) {
+#ifdef VIRTUAL_MEMORY
+		if (size <= committed) return;
+		size_t newCommitted = alignUp(size, commitSize);
+		if (newCommitted > memorySize) newCommitted = memorySize;
+#if defined(_WIN32)
+		bool success = VirtualAlloc(memory + committed, newCommitted - committed, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+		bool success = mprotect(memory + committed, newCommitted - committed, PROT_READ | PROT_WRITE) == 0;
+#endif
+		if (!success) {
+			log(Error, "Could not commit %llu bytes of memory", (unsigned long long)newCommitted);
+			abort();
+		}
+		committed = newCommitted;
+#endif
+	}
+}
+
+Memory::StackAllocator::StackAllocator() : base(nullptr), size(0), top(0), highWater(0) {
+	
+}
+
+void Memory::StackAllocator::init(void* memory, size_t size) {
+	base = (u8*)memory;
+	this->size = size;
+	top = 0;
+	highWater = 0;
+}
+
+void* Memory::StackAllocator::allocate(size_t size, size_t alignment) {
+	size_t start = alignUp((size_t)(base + top), alignment) - (size_t)base;
+	assert(start + size <= this->size);
+	top = start + size;
+	if (top > highWater) highWater = top;
+	return base + start;
+}
+
+void Memory::StackAllocator::freeToMarker(Marker marker) {
+	assert(marker <= top);
+	top = marker;
 }
 
 void Memory::init() {
-	memory = new u8[memorySize];
-	index = scratchPadSize;
+	reserve();
+	commit(mainArenaSize);
+	memoryIndex = mainArenaSize;
+	allocationMutex.Create();
+	
+	mainArena.init(memory, mainArenaSize);
+	currentArena = &mainArena;
+	arenas[numArenas++] = &mainArena;
+	tagStats[TagScratch].bytes += mainArenaSize;
+	++tagStats[TagScratch].count;
+	
+	frameArenas[0] = (u8*)allocate(frameArenaSize, TagFrame);
+	frameArenas[1] = (u8*)allocate(frameArenaSize, TagFrame);
+	frameTop = 0;
+	currentFrameArena = 0;
+	frameHighWater = 0;
+	frameOverflows = 0;
+	frameOverflowsLogged = 0;
+}
+
+Memory::StackAllocator& Memory::threadArena() {
+	if (currentArena == nullptr) {
+		currentArena = new StackAllocator;
+		currentArena->init(allocate(threadArenaSize, TagScratch), threadArenaSize);
+		
+		allocationMutex.Lock();
+		assert(numArenas < maxArenas);
+		if (numArenas < maxArenas) arenas[numArenas++] = currentArena;
+		allocationMutex.Unlock();
+	}
+	return *currentArena;
 }
 
 void* Memory::scratchPad(size_t size) {
-	assert(size < scratchPadSize);
-	return memory;
+	StackAllocator& arena = threadArena();
+#ifdef MEMORY_DEBUG
+	checkScratchGuard();
+	assert(arena.used() + size + guardSize <= arena.capacity());
+	scratchGuard = (u8*)arena.remaining() + size;
+	writeGuard(scratchGuard);
+#endif
+	assert(arena.used() + size <= arena.capacity());
+	arena.touch(size);
+	return arena.remaining();
 }
 
-void* Memory::allocate(size_t size) {
-	assert(index + size < memorySize);
-	void* data = &memory[index];
-	index += size;
+void* Memory::allocate(size_t size, Tag tag) {
+	size_t allocationSize = size;
+#ifdef MEMORY_DEBUG
+	allocationSize += guardSize;
+#endif
+	
+	allocationMutex.Lock();
+	if (memoryIndex + allocationSize > memorySize) {
+		log(Error, "Out of memory, %llu bytes requested", (unsigned long long)size);
+		abort();
+	}
+	commit(memoryIndex + allocationSize);
+	u8* data = &memory[memoryIndex];
+	memoryIndex += allocationSize;
+	
+	tagStats[tag].bytes += size;
+	++tagStats[tag].count;
+	
+#ifdef MEMORY_DEBUG
+	writeGuard(data + size);
+	if (numGuarded < maxGuarded) {
+		guarded[numGuarded].data = data;
+		guarded[numGuarded].size = size;
+		guarded[numGuarded].tag = tag;
+		++numGuarded;
+	}
+#endif
+	allocationMutex.Unlock();
 	return data;
 }
+
+void* Memory::frameAllocate(size_t size, size_t alignment) {
+	// Reserve enough to align the start within the reservation
+	size_t start = frameTop.fetch_add(size + alignment - 1);
+	if (start + size + alignment - 1 > frameArenaSize) {
+		// frameTop keeps growing, so the high water mark shows how large the arena would have to be
+		++frameOverflows;
+		return (void*)alignUp((size_t)allocate(size + alignment - 1, TagFrame), alignment);
+	}
+	u8* arena = frameArenas[currentFrameArena];
+	return (void*)alignUp((size_t)(arena + start), alignment);
+}
+
+void Memory::endFrame() {
+	size_t used = frameTop;
+	if (used > frameHighWater) frameHighWater = used;
+	if (frameOverflows != frameOverflowsLogged) {
+		log(Error, "The frame arena overflowed, %llu of %llu bytes used", (unsigned long long)used, (unsigned long long)frameArenaSize);
+		frameOverflowsLogged = frameOverflows;
+	}
+	
+	currentFrameArena = 1 - currentFrameArena;
+	frameTop = 0;
+	
+#ifdef MEMORY_DEBUG
+	checkGuards();
+#endif
+}
+
+Memory::Stats Memory::getStats() {
+	Stats stats;
+	allocationMutex.Lock();
+	for (int i = 0; i < TagCount; ++i) {
+		stats.tags[i] = tagStats[i];
+	}
+	stats.used = memoryIndex;
+	stats.committed = committed;
+	stats.reserved = memorySize;
+	stats.threadArenaHighWater = 0;
+	for (int i = 0; i < numArenas; ++i) {
+		if (arenas[i]->highWaterMark() > stats.threadArenaHighWater) stats.threadArenaHighWater = arenas[i]->highWaterMark();
+	}
+	allocationMutex.Unlock();
+	
+	stats.threadArenaSize = threadArenaSize;
+	stats.frameHighWater = frameHighWater;
+	stats.frameArenaSize = frameArenaSize;
+	stats.frameOverflows = frameOverflows;
+	return stats;
+}
+
+const char* Memory::tagName(Tag tag) {
+	return tagNames[tag];
+}
+
+void Memory::report() {
+	Stats stats = getStats();
+	log(Info, "Memory: %llu bytes used, %llu committed, %llu reserved", (unsigned long long)stats.used, (unsigned long long)stats.committed, (unsigned long long)stats.reserved);
+	for (int i = 0; i < TagCount; ++i) {
+		log(Info, "  %s: %llu bytes in %llu allocations", tagNames[i], (unsigned long long)stats.tags[i].bytes, (unsigned long long)stats.tags[i].count);
+	}
+	log(Info, "  thread arena high water: %llu of %llu bytes", (unsigned long long)stats.threadArenaHighWater, (unsigned long long)stats.threadArenaSize);
+	log(Info, "  frame arena high water: %llu of %llu bytes, %llu overflows", (unsigned long long)stats.frameHighWater, (unsigned long long)stats.frameArenaSize, (unsigned long long)stats.frameOverflows);
+}
+
+void Memory::exportStats(const char* filename) {
+	Stats stats = getStats();
+	FileWriter writer;
+	if (!writer.open(filename)) {
+		log(Warning, "Could not write memory statistics to %s", filename);
+		return;
+	}
+	
+	char line[256];
+	int length = snprintf(line, sizeof(line), "name,bytes,count,capacity\n");
+	writer.write(line, length);
+	for (int i = 0; i < TagCount; ++i) {
+		length = snprintf(line, sizeof(line), "%s,%llu,%llu,\n", tagNames[i], (unsigned long long)stats.tags[i].bytes, (unsigned long long)stats.tags[i].count);
+		writer.write(line, length);
+	}
+	length = snprintf(line, sizeof(line), "arena,%llu,,%llu\n", (unsigned long long)stats.used, (unsigned long long)stats.reserved);
+	writer.write(line, length);
+	length = snprintf(line, sizeof(line), "thread arena high water,%llu,,%llu\n", (unsigned long long)stats.threadArenaHighWater, (unsigned long long)stats.threadArenaSize);
+	writer.write(line, length);
+	length = snprintf(line, sizeof(line), "frame arena high water,%llu,,%llu\n", (unsigned long long)stats.frameHighWater, (unsigned long long)stats.frameArenaSize);
+	writer.write(line, length);
+	length = snprintf(line, sizeof(line), "frame arena overflows,,%llu,\n", (unsigned long long)stats.frameOverflows);
+	writer.write(line, length);
+	writer.close();
+}
+
+void Memory::checkGuards() {
+#ifdef MEMORY_DEBUG
+	checkScratchGuard();
+	
+	bool intact = true;
+	allocationMutex.Lock();
+	for (int i = 0; i < numGuarded; ++i) {
+		if (!guardIntact(guarded[i].data + guarded[i].size)) {
+			log(Error, "Memory overflow behind %s allocation of %llu bytes at %p", tagNames[guarded[i].tag], (unsigned long long)guarded[i].size, guarded[i].data);
+			intact = false;
+		}
+	}
+	allocationMutex.Unlock();
+	assert(intact);
+#endif
+}
@@ -3,17 +3,154 @@
 #include <stdlib.h>
 
 namespace Memory {
+	// What the memory is used for, statistics are kept per tag
+	enum Tag {
+		TagGeneral,
+		TagMesh,
+		TagPhysics,
+		TagParticles,
+		TagScratch,
+		TagFrame,
+		TagCount
+	};
+	
 	void init();
 	
-	void* allocate(size_t size);
+	// Allocations are never freed and never move. The memory grows on demand where virtual memory is available.
+	void* allocate(size_t size, Tag tag = TagGeneral);
 	
-	template<class T> T* allocate(size_t count = 1) {
-		return (T*)allocate(count * sizeof(T));
+	template<class T> T* allocate(size_t count = 1, Tag tag = TagGeneral) {
+		return (T*)allocate(count * sizeof(T), tag);
 	}
 	
+	// Temporary memory of the calling thread, every thread has its own scratch pad
 	void* scratchPad(size_t size);
 	
 	template<class T> T* scratchPad(size_t count = 1) {
 		return (T*)scratchPad(count * sizeof(T));
 	}
+	
+	// A linear allocator that can be rolled back to a marker or cleared in O(1)
+	class StackAllocator {
+	public:
+		typedef size_t Marker;
+		
+		StackAllocator();
+		
+		void init(void* memory, size_t size);
+		
+		void* allocate(size_t size, size_t alignment = 16);
+		
+		template<class T> T* allocate(size_t count = 1) {
+			return (T*)allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+		}
+		
+		Marker getMarker() const {
+			return top;
+		}
+		
+		// Free everything that was allocated after the marker was taken
+		void freeToMarker(Marker marker);
+		
+		void clear() {
+			top = 0;
+		}
+		
+		// The unused memory, without allocating it
+		void* remaining() const {
+			return base + top;
+		}
+		
+		size_t used() const {
+			return top;
+		}
+		
+		size_t capacity() const {
+			return size;
+		}
+		
+		// The most memory that was ever in use
+		size_t highWaterMark() const {
+			return highWater;
+		}
+		
+		// Record memory that is used without allocating it (see scratchPad)
+		void touch(size_t size) {
+			if (top + size > highWater) highWater = top + size;
+		}
+		
+	private:
+		unsigned char* base;
+		size_t size;
+		size_t top;
+		size_t highWater;
+	};
+	
+	// Frees everything allocated from the allocator during its lifetime
+	class StackScope {
+	public:
+		StackScope(StackAllocator& allocator) : allocator(allocator), marker(allocator.getMarker()) {}
+		
+		~StackScope() {
+			allocator.freeToMarker(marker);
+		}
+		
+	private:
+		StackScope(const StackScope&);
+		StackScope& operator=(const StackScope&);
+		
+		StackAllocator& allocator;
+		StackAllocator::Marker marker;
+	};
+	
+	// The arena of the calling thread, created on first use
+	StackAllocator& threadArena();
+	
+	// Memory that stays valid until the end of the next frame. When the frame arena is full the memory
+	// is taken from the arena like with allocate, and the overflow is logged and counted in the statistics.
+	// Render thread only, endFrame switches the arenas without synchronizing with other threads.
+	void* frameAllocate(size_t size, size_t alignment = 16);
+	
+	template<class T> T* frameAllocate(size_t count = 1) {
+		return (T*)frameAllocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16);
+	}
+	
+	// Switches to the other frame arena and clears it, call once per frame after Graphics4::end
+	void endFrame();
+	
+	struct TagStats {
+		size_t bytes;
+		size_t count;
+	};
+	
+	struct Stats {
+		TagStats tags[TagCount];
+		
+		// Bytes allocated from the arena, committed and reserved
+		size_t used;
+		size_t committed;
+		size_t reserved;
+		
+		// The most memory ever used by any thread arena (including scratch pad use) and by a frame
+		size_t threadArenaHighWater;
+		size_t threadArenaSize;
+		size_t frameHighWater;
+		size_t frameArenaSize;
+		// The frame allocations that did not fit and were taken from the arena instead (they are never freed)
+		size_t frameOverflows;
+	};
+	
+	Stats getStats();
+	
+	const char* tagName(Tag tag);
+	
+	// Log the statistics
+	void report();
+	
+	// Write the statistics to a CSV file
+	void exportStats(const char* filename);
+	
+	// With MEMORY_DEBUG defined every allocation is followed by guard bytes.
+	// Reports every allocation that wrote past its end and asserts if there was one.
+	void checkGuards();
 }
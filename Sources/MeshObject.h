@@ -10,55 +10,115 @@
 #include <Kore/Graphics4/Graphics.h>
 #include <Kore/Log.h>
 #include "ObjLoader.h"
+#include "AssetLoader.h"
 #include "ShaderProgram.h"
+#include "RenderQueue.h"
+#include "Frustum.h"
+#include "MeshSimplifier.h"
+#include "Profiler.h"
+#include "Counters.h"
 
 using namespace Kore;
 
 class MeshObject {
 public:
 	MeshObject(const char* meshFile, const char* textureFile, const Graphics4::VertexStructure& structure, ShaderProgram* shaderProgram, float scale = 1.0f) : shaderProgram(shaderProgram) {
-		mesh = loadObj(meshFile);
-		image = new Graphics4::Texture(textureFile);
-		
-		vertexBuffer = new Graphics4::VertexBuffer(mesh->numVertices, structure,0);
-		float* vertices = vertexBuffer->lock();
-		for (int i = 0; i < mesh->numVertices; ++i) {
-			vertices[i * 8 + 0] = mesh->vertices[i * 8 + 0] * scale;
-			vertices[i * 8 + 1] = mesh->vertices[i * 8 + 1] * scale;
-			vertices[i * 8 + 2] = mesh->vertices[i * 8 + 2] * scale;
-			vertices[i * 8 + 3] = mesh->vertices[i * 8 + 3];
-			vertices[i * 8 + 4] = 1.0f - mesh->vertices[i * 8 + 4];
-			vertices[i * 8 + 5] = mesh->vertices[i * 8 + 5];
-			vertices[i * 8 + 6] = mesh->vertices[i * 8 + 6];
-			vertices[i * 8 + 7] = mesh->vertices[i * 8 + 7];
-		}
-		vertexBuffer->unlock();
-		
-		indexBuffer = new Graphics4::IndexBuffer(mesh->numFaces * 3);
-		int* indices = indexBuffer->lock();
-		for (int i = 0; i < mesh->numFaces * 3; i++) {
-			indices[i] = mesh->indices[i];
-		}
-		indexBuffer->unlock();
+		mesh = new MeshHandle;
+		Mesh* data = loadObj(meshFile);
+		generateLods(data);
+		AssetLoader::uploadMesh(mesh, data, structure, scale);
+		image = new TextureHandle;
+		image->texture = new Graphics4::Texture(textureFile);
 		
 		M = mat4::Identity();
 	}
 	
+	// Uses meshes and textures that are shared with other objects and possibly still loading (see AssetLoader and AssetCache)
+	MeshObject(MeshHandle* mesh, TextureHandle* image, ShaderProgram* shaderProgram) : mesh(mesh), shaderProgram(shaderProgram), image(image) {
+		M = mat4::Identity();
+	}
+	
+	// Meshes that are still loading are not rendered
+	bool isReady() const {
+		return mesh->isReady() && image->isReady();
+	}
+	
 	void render(const SceneParameters& parameters) {
-		shaderProgram->Set(parameters, M, image);
-		Graphics4::setVertexBuffer(*vertexBuffer);
-		Graphics4::setIndexBuffer(*indexBuffer);
+		PROFILE_ZONE("MeshObject::render");
+		if (!isReady()) return;
+		
+		vec3 center;
+		float radius;
+		getBounds(center, radius);
+		
+		shaderProgram->Set(parameters, M * mesh->decode, image->texture);
+		Graphics4::setVertexBuffer(*mesh->vertexBuffer);
+		Graphics4::setIndexBuffer(*selectLod(parameters, center, radius));
 		Graphics4::drawIndexedVertices();
+		Counters::add(Counters::DrawCalls);
+	}
+	
+	// Bounding sphere in world space, only valid when the mesh is ready
+	void getBounds(vec3& center, float& radius) const {
+		Mesh* data = mesh->mesh;
+		vec4 worldCenter = M * vec4(data->boundsCenter[0] * mesh->scale, data->boundsCenter[1] * mesh->scale, data->boundsCenter[2] * mesh->scale, 1.0f);
+		center = vec3(worldCenter.x(), worldCenter.y(), worldCenter.z());
+		
+		// The largest scale of the matrix
+		float maxScaleSquared = 0;
+		for (int column = 0; column < 3; ++column) {
+			float scaleSquared = M.get(0, column) * M.get(0, column) + M.get(1, column) * M.get(1, column) + M.get(2, column) * M.get(2, column);
+			if (scaleSquared > maxScaleSquared) maxScaleSquared = scaleSquared;
+		}
+		radius = data->boundsRadius * mesh->scale * Kore::sqrt(maxScaleSquared);
+	}
+	
+	// Queue the draw instead of drawing right away, objects outside of the frustum are skipped
+	void submit(RenderQueue& queue, const SceneParameters& parameters, Frustum* frustum = nullptr) {
+		if (!isReady()) return;
+		
+		vec3 center;
+		float radius;
+		getBounds(center, radius);
+		if (frustum != nullptr && !frustum->isVisible(center, radius)) return;
+		
+		vec4 position = parameters.PV * (M * vec4(0, 0, 0, 1));
+		queue.submit(shaderProgram, image->texture, mesh->vertexBuffer, selectLod(parameters, center, radius), M * mesh->decode, parameters.tint, position.w());
+	}
+	
+	// Pick the level of detail from the size of the bounding sphere on screen.
+	// The full mesh is used down to lodScreenSize of half the screen height, every further halving of the size drops one level.
+	Graphics4::IndexBuffer* selectLod(const SceneParameters& parameters, const vec3& center, float radius) const {
+		if (mesh->numLods == 1) return mesh->indexBuffer;
+		
+		float distance = (center - parameters.cameraPosition).getLength();
+		if (distance <= radius) return mesh->indexBuffer;
+		
+		const float lodScreenSize = 0.25f;
+		float screenSize = radius * parameters.projectionScale / distance * parameters.lodBias;
+		int lod = 0;
+		float threshold = lodScreenSize;
+		while (lod + 1 < mesh->numLods && screenSize < threshold) {
+			++lod;
+			threshold *= 0.5f;
+		}
+		return mesh->lodIndexBuffers[lod];
+	}
+	
+	MeshHandle* getMesh() const {
+		return mesh;
+	}
+	
+	TextureHandle* getTexture() const {
+		return image;
 	}
 	
 	mat4 M;
 	
 private:
-	Mesh* mesh;
+	MeshHandle* mesh;
 	
 	ShaderProgram* shaderProgram;
-	Graphics4::VertexBuffer* vertexBuffer;
-	Graphics4::IndexBuffer* indexBuffer;
 	
-	Graphics4::Texture* image;
+	TextureHandle* image;
 };
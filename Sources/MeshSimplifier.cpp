@@ -0,0 +1,418 @@
+#include "pch.h"
+
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+#include "Memory.h"
+
+#include <Kore/Log.h>
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace {
+	// Meshes with fewer triangles are not simplified
+	const int minLodTriangles = 64;
+	
+	// How much more the planes along borders and uv seams count than the planes of the triangles
+	const float borderWeight = 100.0f;
+	
+	// Symmetric 4x4 matrix, stored as its upper triangle
+	struct Quadric {
+		float a[10];
+		
+		void clear() {
+			for (int i = 0; i < 10; ++i) a[i] = 0;
+		}
+		
+		// Add the plane nx * x + ny * y + nz * z + d = 0, weighted
+		void addPlane(float nx, float ny, float nz, float d, float weight) {
+			a[0] += weight * nx * nx; a[1] += weight * nx * ny; a[2] += weight * nx * nz; a[3] += weight * nx * d;
+			a[4] += weight * ny * ny; a[5] += weight * ny * nz; a[6] += weight * ny * d;
+			a[7] += weight * nz * nz; a[8] += weight * nz * d;
+			a[9] += weight * d * d;
+		}
+		
+		void add(const Quadric& other) {
+			for (int i = 0; i < 10; ++i) a[i] += other.a[i];
+		}
+		
+		// The squared distance sum of the point to all planes
+		float error(float x, float y, float z) const {
+			return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			     + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			     + a[7] * z * z + 2 * a[8] * z
+			     + a[9];
+		}
+	};
+	
+	// Collapses the position from onto the position to, run is the Run of from towards to
+	struct Edge {
+		int from;
+		int to;
+		int run;
+		float cost;
+	};
+	
+	// A vertex index and a neighbour in one triangle, with the positions they are welded to
+	struct Link {
+		int position;
+		int target;
+		int vertex;
+		int neighbour;
+		int triangle;
+	};
+	
+	bool linkLess(const Link& a, const Link& b) {
+		if (a.position != b.position) return a.position < b.position;
+		if (a.target != b.target) return a.target < b.target;
+		if (a.vertex != b.vertex) return a.vertex < b.vertex;
+		return a.neighbour < b.neighbour;
+	}
+	
+	// The links from one position to another, one per triangle that has the edge
+	struct Run {
+		int position;
+		int target;
+		int start;
+		int length;
+		// The number of copies of position that share a triangle with target
+		int linked;
+		// The triangles use different copies of the positions, the edge is on a uv seam
+		bool seam;
+	};
+	
+	bool edgeLess(const Edge& a, const Edge& b) {
+		return a.cost < b.cost;
+	}
+	
+	struct PositionLess {
+		const float* vertices;
+		
+		bool operator()(int a, int b) const {
+			const float* p = &vertices[a * 8];
+			const float* q = &vertices[b * 8];
+			if (p[0] != q[0]) return p[0] < q[0];
+			if (p[1] != q[1]) return p[1] < q[1];
+			if (p[2] != q[2]) return p[2] < q[2];
+			return a < b;
+		}
+	};
+	
+	// welded[v] is the first of the used vertices with the position of v, the meshes split vertices at uv seams.
+	// Temporaries go to the thread arena of the caller.
+	void weldPositions(const float* vertices, int numVertices, const int* indices, int numIndices, int* welded) {
+		Memory::StackAllocator& arena = Memory::threadArena();
+		bool* used = arena.allocate<bool>(numVertices);
+		int* order = arena.allocate<int>(numVertices);
+		for (int i = 0; i < numVertices; ++i) {
+			used[i] = false;
+			welded[i] = i;
+		}
+		for (int i = 0; i < numIndices; ++i) {
+			used[indices[i]] = true;
+		}
+		int numUsed = 0;
+		for (int i = 0; i < numVertices; ++i) {
+			if (used[i]) order[numUsed++] = i;
+		}
+		
+		PositionLess less = { vertices };
+		std::sort(order, order + numUsed, less);
+		for (int i = 1; i < numUsed; ++i) {
+			const float* p = &vertices[order[i - 1] * 8];
+			const float* q = &vertices[order[i] * 8];
+			if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2]) {
+				welded[order[i]] = welded[order[i - 1]];
+			}
+		}
+	}
+	
+	// Sort the welded edges of the triangles into pairs, the smaller vertex in the upper half. Returns their number.
+	int weldedEdges(const int* indices, int numIndices, const int* welded, unsigned long long* pairs) {
+		int numPairs = 0;
+		for (int i = 0; i + 2 < numIndices; i += 3) {
+			for (int j = 0; j < 3; ++j) {
+				unsigned v0 = (unsigned)welded[indices[i + j]];
+				unsigned v1 = (unsigned)welded[indices[i + (j + 1) % 3]];
+				pairs[numPairs++] = v0 < v1 ? (unsigned long long)v0 << 32 | v1 : (unsigned long long)v1 << 32 | v0;
+			}
+		}
+		std::sort(pairs, pairs + numPairs);
+		return numPairs;
+	}
+	
+	// The edges that only one triangle uses, the borders and the holes of the mesh
+	int countOpenEdges(const float* vertices, int numVertices, const int* indices, int numIndices) {
+		Memory::StackScope scope(Memory::threadArena());
+		int* welded = Memory::threadArena().allocate<int>(numVertices);
+		unsigned long long* pairs = Memory::threadArena().allocate<unsigned long long>(numIndices);
+		weldPositions(vertices, numVertices, indices, numIndices, welded);
+		int numPairs = weldedEdges(indices, numIndices, welded, pairs);
+		
+		int open = 0;
+		for (int i = 0; i < numPairs; ++i) {
+			bool shared = (i > 0 && pairs[i - 1] == pairs[i]) || (i + 1 < numPairs && pairs[i + 1] == pairs[i]);
+			if (!shared) ++open;
+		}
+		return open;
+	}
+	
+	// Both directions of every triangle edge, sorted by positions. Returns their number.
+	int buildLinks(const int* indices, int numIndices, const int* welded, Link* links) {
+		int numLinks = 0;
+		for (int i = 0; i + 2 < numIndices; i += 3) {
+			for (int j = 0; j < 3; ++j) {
+				int v0 = indices[i + j];
+				int v1 = indices[i + (j + 1) % 3];
+				Link forward = { welded[v0], welded[v1], v0, v1, i / 3 };
+				Link backward = { welded[v1], welded[v0], v1, v0, i / 3 };
+				links[numLinks++] = forward;
+				links[numLinks++] = backward;
+			}
+		}
+		std::sort(links, links + numLinks, linkLess);
+		return numLinks;
+	}
+	
+	int buildRuns(const Link* links, int numLinks, Run* runs) {
+		int numRuns = 0;
+		for (int i = 0; i < numLinks; ++i) {
+			if (i > 0 && links[i].position == links[i - 1].position && links[i].target == links[i - 1].target) {
+				Run& run = runs[numRuns - 1];
+				++run.length;
+				if (links[i].vertex != links[i - 1].vertex) {
+					++run.linked;
+					run.seam = true;
+				}
+				if (links[i].neighbour != links[run.start].neighbour) run.seam = true;
+				continue;
+			}
+			Run& run = runs[numRuns++];
+			run.position = links[i].position;
+			run.target = links[i].target;
+			run.start = i;
+			run.length = 1;
+			run.linked = 1;
+			run.seam = false;
+		}
+		return numRuns;
+	}
+	
+	const Run* findRun(const Run* runs, int numRuns, int position, int target) {
+		int low = 0;
+		int high = numRuns;
+		while (low < high) {
+			int middle = (low + high) / 2;
+			const Run& run = runs[middle];
+			if (run.position < position || (run.position == position && run.target < target)) low = middle + 1;
+			else high = middle;
+		}
+		if (low < numRuns && runs[low].position == position && runs[low].target == target) return &runs[low];
+		return nullptr;
+	}
+	
+	// The plane of a triangle, returns its area (0 for degenerate triangles)
+	float trianglePlane(const float* vertices, const int* triangle, float* n, float& d) {
+		const float* p0 = &vertices[triangle[0] * 8];
+		const float* p1 = &vertices[triangle[1] * 8];
+		const float* p2 = &vertices[triangle[2] * 8];
+		float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0) return 0;
+		n[0] /= length; n[1] /= length; n[2] /= length;
+		d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		return length * 0.5f;
+	}
+	
+	int find(int* remap, int vertex) {
+		while (remap[vertex] != vertex) {
+			remap[vertex] = remap[remap[vertex]];
+			vertex = remap[vertex];
+		}
+		return vertex;
+	}
+}
+
+int simplifyMesh(const float* vertices, int numVertices, const int* indices, int numIndices, int targetIndexCount, int* result) {
+	Memory::StackAllocator& arena = Memory::threadArena();
+	Memory::StackScope scope(arena);
+	
+	// The meshes split vertices at uv seams, so the simplification works on positions: every vertex index
+	// is welded to the first one at its position, which also holds the quadric of the position
+	int* welded = arena.allocate<int>(numVertices);
+	Quadric* quadrics = arena.allocate<Quadric>(numVertices);
+	int* remap = arena.allocate<int>(numVertices);
+	int* copies = arena.allocate<int>(numVertices);
+	bool* border = arena.allocate<bool>(numVertices);
+	bool* locked = arena.allocate<bool>(numVertices);
+	Link* links = arena.allocate<Link>(numIndices * 2);
+	Run* runs = arena.allocate<Run>(numIndices * 2);
+	Edge* edges = arena.allocate<Edge>(numIndices);
+	
+	weldPositions(vertices, numVertices, indices, numIndices, welded);
+	for (int i = 0; i < numVertices; ++i) {
+		quadrics[i].clear();
+		remap[i] = i;
+	}
+	
+	// Every position starts with the planes of its triangles, weighted by area
+	for (int i = 0; i + 2 < numIndices; i += 3) {
+		float n[3];
+		float d;
+		float area = trianglePlane(vertices, &indices[i], n, d);
+		if (area == 0) continue;
+		for (int j = 0; j < 3; ++j) {
+			quadrics[welded[indices[i + j]]].addPlane(n[0], n[1], n[2], d, area);
+		}
+	}
+	
+	// Borders and uv seams get planes through the edge that are perpendicular to the triangle,
+	// which keep their outline when the positions next to them collapse
+	int numLinks = buildLinks(indices, numIndices, welded, links);
+	int numRuns = buildRuns(links, numLinks, runs);
+	for (int r = 0; r < numRuns; ++r) {
+		const Run& run = runs[r];
+		if (run.position > run.target || !(run.length == 1 || run.seam)) continue;
+		const float* p0 = &vertices[run.position * 8];
+		const float* p1 = &vertices[run.target * 8];
+		float e[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float lengthSquared = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+		for (int i = run.start; i < run.start + run.length; ++i) {
+			float n[3];
+			float d;
+			if (trianglePlane(vertices, &indices[links[i].triangle * 3], n, d) == 0) continue;
+			float m[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+			float length = sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+			if (length == 0) continue;
+			m[0] /= length; m[1] /= length; m[2] /= length;
+			float md = -(m[0] * p0[0] + m[1] * p0[1] + m[2] * p0[2]);
+			quadrics[run.position].addPlane(m[0], m[1], m[2], md, borderWeight * lengthSquared);
+			quadrics[run.target].addPlane(m[0], m[1], m[2], md, borderWeight * lengthSquared);
+		}
+	}
+	
+	memcpy(result, indices, numIndices * sizeof(int));
+	int count = numIndices;
+	
+	while (count > targetIndexCount) {
+		numLinks = buildLinks(result, count, welded, links);
+		numRuns = buildRuns(links, numLinks, runs);
+		
+		// The vertex indices that are still used per position, and the positions on a border
+		for (int i = 0; i < numVertices; ++i) {
+			copies[i] = 0;
+			border[i] = false;
+			locked[i] = false;
+		}
+		for (int i = 0; i < count; ++i) {
+			if (locked[result[i]]) continue;
+			locked[result[i]] = true;
+			++copies[welded[result[i]]];
+		}
+		for (int i = 0; i < count; ++i) {
+			locked[result[i]] = false;
+		}
+		for (int r = 0; r < numRuns; ++r) {
+			if (runs[r].length == 1) border[runs[r].position] = true;
+		}
+		
+		// A position can collapse onto a neighbour when each of its copies shares a triangle with a copy of the neighbour,
+		// so that all of them move together, and positions on a border may only move along it
+		int numEdges = 0;
+		for (int r = 0; r < numRuns; ++r) {
+			const Run& run = runs[r];
+			if (run.position > run.target) continue;
+			const Run* reverse = findRun(runs, numRuns, run.target, run.position);
+			bool towardsTarget = run.linked == copies[run.position] && (!border[run.position] || run.length == 1);
+			bool towardsPosition = reverse != nullptr && reverse->linked == copies[run.target] && (!border[run.target] || run.length == 1);
+			if (!towardsTarget && !towardsPosition) continue;
+			
+			Quadric q = quadrics[run.position];
+			q.add(quadrics[run.target]);
+			const float* p0 = &vertices[run.position * 8];
+			const float* p1 = &vertices[run.target * 8];
+			float toTarget = q.error(p1[0], p1[1], p1[2]);
+			float toPosition = q.error(p0[0], p0[1], p0[2]);
+			if (towardsTarget && towardsPosition) towardsTarget = toTarget <= toPosition;
+			
+			Edge& edge = edges[numEdges++];
+			edge.from = towardsTarget ? run.position : run.target;
+			edge.to = towardsTarget ? run.target : run.position;
+			edge.run = towardsTarget ? r : (int)(reverse - runs);
+			edge.cost = towardsTarget ? toTarget : toPosition;
+		}
+		std::sort(edges, edges + numEdges, edgeLess);
+		
+		// Collapse the cheapest edges, each position at most once per pass so the costs stay valid.
+		// Every copy moves onto the copy of the target that it shares a triangle with.
+		int trianglesToRemove = (count - targetIndexCount) / 3;
+		int collapses = 0;
+		for (int i = 0; i < numEdges && collapses < trianglesToRemove / 2 + 1; ++i) {
+			Edge& edge = edges[i];
+			if (locked[edge.from] || locked[edge.to]) continue;
+			locked[edge.from] = true;
+			locked[edge.to] = true;
+			const Run& run = runs[edge.run];
+			for (int j = run.start; j < run.start + run.length; ++j) {
+				remap[links[j].vertex] = links[j].neighbour;
+			}
+			quadrics[edge.to].add(quadrics[edge.from]);
+			++collapses;
+		}
+		if (collapses == 0) break;
+		
+		// Apply the collapses and drop the triangles that became degenerate
+		int newCount = 0;
+		for (int i = 0; i < count; i += 3) {
+			int v0 = find(remap, result[i + 0]);
+			int v1 = find(remap, result[i + 1]);
+			int v2 = find(remap, result[i + 2]);
+			if (welded[v0] == welded[v1] || welded[v1] == welded[v2] || welded[v2] == welded[v0]) continue;
+			result[newCount++] = v0;
+			result[newCount++] = v1;
+			result[newCount++] = v2;
+		}
+		if (newCount == count) break;
+		count = newCount;
+	}
+	
+	return count;
+}
+
+void generateLods(Mesh* mesh, int lodCount) {
+	int triangles = mesh->numFaces;
+	int openEdges = countOpenEdges(mesh->vertices, mesh->numVertices, mesh->indices, triangles * 3);
+	
+	mesh->numLods = 1;
+	mesh->lodIndices[0] = mesh->indices;
+	mesh->lodIndexCounts[0] = triangles * 3;
+	
+	for (int lod = 1; lod < lodCount && lod < maxMeshLods; ++lod) {
+		triangles /= 2;
+		if (triangles < minLodTriangles) break;
+		
+		// Continue from the previous level, it is smaller and already simplified
+		Memory::StackScope scope(Memory::threadArena());
+		int* indices = Memory::threadArena().allocate<int>(mesh->lodIndexCounts[lod - 1]);
+		int count = simplifyMesh(mesh->vertices, mesh->numVertices, mesh->lodIndices[lod - 1], mesh->lodIndexCounts[lod - 1], triangles * 3, indices);
+		// Flat shaded meshes split every vertex, they can hardly be simplified without tearing the seams.
+		// A level that keeps more than three quarters of the triangles is not worth its index buffer.
+		if (count > mesh->lodIndexCounts[lod - 1] / 4 * 3) break;
+		
+		// A level must not open holes that the mesh does not have
+		if (countOpenEdges(mesh->vertices, mesh->numVertices, indices, count) > openEdges) {
+			Kore::log(Kore::Warning, "Level %d of a mesh has holes, it is dropped", lod);
+			break;
+		}
+		
+		mesh->lodIndices[lod] = Memory::allocate<int>(count, Memory::TagMesh);
+		memcpy(mesh->lodIndices[lod], indices, count * sizeof(int));
+		mesh->lodIndexCounts[lod] = count;
+		mesh->numLods = lod + 1;
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "ObjLoader.h"
+
+// Simplify the triangles of a mesh with quadric error metrics (Garland and Heckbert).
+// Edges are collapsed onto one of their vertices, so the simplified triangles reuse the vertex buffer of the mesh.
+// result needs room for numIndices indices. Returns the number of indices written, which is
+// above targetIndexCount when the mesh could not be simplified further.
+int simplifyMesh(const float* vertices, int numVertices, const int* indices, int numIndices, int targetIndexCount, int* result);
+
+// Add up to lodCount - 1 simplified index lists to the mesh, each with about half the triangles of the previous one.
+// Small meshes get fewer levels.
+void generateLods(Mesh* mesh, int lodCount = maxMeshLods);
@@ -1,9 +1,11 @@
 #include "pch.h"
 #include "ObjLoader.h"
 #include "Memory.h"
-#include <Kore/IO/FileReader.h>
+#include "Profiler.h"
+#include "Archive.h"
 #include <cstring>
 #include <cstdlib>
+#include <math.h>
 #include <assert.h>
 
 using namespace Kore;
@@ -11,6 +13,16 @@ using namespace Kore;
 namespace {
 	const int maxTokenLength = 256;
 	
+	// The next word of a line, context keeps the position between the calls.
+	// Meshes are loaded on several threads at once, so strtok and its hidden state can not be used.
+	char* nextToken(char* line, char** context) {
+#ifdef _WIN32
+		return strtok_s(line, " ", context);
+#else
+		return strtok_r(line, " ", context);
+#endif
+	}
+	
 	void tokenize(char* s, char delimiter, int& i, char* token) {
 		int lastIndex = i;
 		char* index = strchr(s + lastIndex + 1, delimiter);
@@ -43,10 +55,11 @@ namespace {
 	}
 	
 	int countFacesInLine(char* line) {
-		char* token = strtok(line, " ");
+		char* context;
+		char* token = nextToken(line, &context);
 		int i = -1;
 		while (token != nullptr) {
-			token = strtok(nullptr, " ");
+			token = nextToken(nullptr, &context);
 			i++;
 		}
 		
@@ -88,10 +101,10 @@ namespace {
 		return countFirstCharLines(source, "vt ");
 	}
 	
-	void parseVertex(Mesh* mesh, char* line) {
+	void parseVertex(Mesh* mesh, char** context) {
 		char* token;
 		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
+			token = nextToken(nullptr, context);
 			mesh->curVertex[i] = (float)strtod(token, nullptr);
 		}
 		
@@ -114,7 +127,7 @@ namespace {
 		mesh->vertices[(index * 8) + 7] = z;
 	}
 	
-	void parseFace(Mesh* mesh, char* line) {
+	void parseFace(Mesh* mesh, char** context) {
 		char* token;
 		int verts[4];
 		int uvIndex[4];
@@ -122,7 +135,7 @@ namespace {
 		bool hasUV[4];
 		bool hasNormal[4];
 		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
+			token = nextToken(nullptr, context);
 			char* endPtr;
 			verts[i] = (int)strtol(token, &endPtr, 0) - 1;
 			if (endPtr[0] == '/') {
@@ -139,7 +152,7 @@ namespace {
 				normalIndex[i] = (int)strtol(endPtr + 1, nullptr, 0) - 1;
 			}
 		}
-		token = strtok(nullptr, " ");
+		token = nextToken(nullptr, context);
 		//char* result;
 		if (token != nullptr) {
 			verts[3] = (int)strtol(token, nullptr, 0) - 1;
@@ -176,38 +189,65 @@ namespace {
 		}
 	}
 	
-	void parseUV(Mesh* mesh, char* line) {
+	void parseUV(Mesh* mesh, char** context) {
 		char* token;
 		for (int i = 0; i < 2; i++) {
-			token = strtok(nullptr, " ");
+			token = nextToken(nullptr, context);
 			*mesh->curUV = (float)strtod(token, nullptr);
 			mesh->curUV++;
 		}
 	}
 	
-	void parseNormal(Mesh* mesh, char* line) {
+	void parseNormal(Mesh* mesh, char** context) {
 		char* token;
 		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
+			token = nextToken(nullptr, context);
 			*mesh->curNormal = (float)strtod(token, nullptr);
 			mesh->curNormal++;
 		}
 	}
 	
+	// The center of the bounding box and the largest distance of a vertex from it
+	void computeBounds(Mesh* mesh) {
+		float min[3] = { 0, 0, 0 };
+		float max[3] = { 0, 0, 0 };
+		for (int i = 0; i < mesh->numVertices; ++i) {
+			for (int j = 0; j < 3; ++j) {
+				float value = mesh->vertices[i * 8 + j];
+				if (i == 0 || value < min[j]) min[j] = value;
+				if (i == 0 || value > max[j]) max[j] = value;
+			}
+		}
+		
+		float radiusSquared = 0;
+		for (int j = 0; j < 3; ++j) {
+			mesh->boundsCenter[j] = (min[j] + max[j]) * 0.5f;
+		}
+		for (int i = 0; i < mesh->numVertices; ++i) {
+			float x = mesh->vertices[i * 8 + 0] - mesh->boundsCenter[0];
+			float y = mesh->vertices[i * 8 + 1] - mesh->boundsCenter[1];
+			float z = mesh->vertices[i * 8 + 2] - mesh->boundsCenter[2];
+			float distanceSquared = x * x + y * y + z * z;
+			if (distanceSquared > radiusSquared) radiusSquared = distanceSquared;
+		}
+		mesh->boundsRadius = sqrtf(radiusSquared);
+	}
+	
 	void parseLine(Mesh* mesh, char* line) {
-		char* token = strtok(line, " ");
+		char* context;
+		char* token = nextToken(line, &context);
 		if (strcmp(token, "v") == 0) {
 			// Read some vertex data
-			parseVertex(mesh, line);
+			parseVertex(mesh, &context);
 		}
 		else if (strcmp(token, "f") == 0) {
 			// Read some face data
-			parseFace(mesh, line);
+			parseFace(mesh, &context);
 		}
 		else if (strcmp(token, "vt") == 0) {
-			parseUV(mesh, line);
+			parseUV(mesh, &context);
 		} else if (strcmp(token, "vn") == 0) {
-			parseNormal(mesh, line);
+			parseNormal(mesh, &context);
 		}
 		
 		// Ignore all other commands (for now)
@@ -215,27 +255,28 @@ namespace {
 }
 
 Mesh* loadObj(const char* filename) {
-	FileReader fileReader(filename, FileReader::Asset);
-	void* data = fileReader.readAll();
-	int length = fileReader.size() + 1;
-	char* source = Memory::scratchPad<char>(length);
-	memcpy(source, data, length);
+	PROFILE_ZONE("loadObj");
+	// The parser needs a null terminated copy that it can write to
+	AssetFile file(filename);
+	int length = file.size();
+	char* source = Memory::scratchPad<char>(length + 1);
+	memcpy(source, file.data(), length);
 	source[length] = 0;
 	
-	Mesh* mesh = Memory::allocate<Mesh>();
+	Mesh* mesh = Memory::allocate<Mesh>(1, Memory::TagMesh);
 	mesh->numIndices = 0;
 	int vertices = countVertices(source);
-	mesh->vertices = Memory::allocate<float>(vertices * 8);
+	mesh->vertices = Memory::allocate<float>(vertices * 8, Memory::TagMesh);
 	mesh->curVertex = mesh->vertices;
 	int faces = countFaces(source);
-	mesh->indices = Memory::allocate<int>(faces * 3);
+	mesh->indices = Memory::allocate<int>(faces * 3, Memory::TagMesh);
 	mesh->curIndex = mesh->indices;
 	mesh->numUVs = countUVs(source);
-	mesh->uvs = Memory::allocate<float>(mesh->numUVs * 2);
+	mesh->uvs = Memory::allocate<float>(mesh->numUVs * 2, Memory::TagMesh);
 	mesh->curUV = mesh->uvs;
 	int normals = countNormals(source);
 	mesh->numNormals = normals;
-	mesh->normals = Memory::allocate<float>(normals * 3);
+	mesh->normals = Memory::allocate<float>(normals * 3, Memory::TagMesh);
 	mesh->curNormal = mesh->normals;
 	
 	mesh->numVertices = 0;
@@ -250,5 +291,11 @@ Mesh* loadObj(const char* filename) {
 		tokenize(source, '\n', index, line);
 	}
 	
+	computeBounds(mesh);
+	
+	mesh->numLods = 1;
+	mesh->lodIndices[0] = mesh->indices;
+	mesh->lodIndexCounts[0] = mesh->numFaces * 3;
+	
 	return mesh;
 }
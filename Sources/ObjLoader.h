@@ -1,5 +1,7 @@
 #pragma once
 
+const int maxMeshLods = 4;
+
 struct Mesh {
 	int numFaces;
 	int numVertices;
@@ -12,6 +14,15 @@ struct Mesh {
 	float* uvs;
 	float * normals;
 	
+	// Bounding sphere of the vertex positions
+	float boundsCenter[3];
+	float boundsRadius;
+	
+	// Simplified index lists, lod 0 is indices (see generateLods)
+	int numLods;
+	int* lodIndices[maxMeshLods];
+	int lodIndexCounts[maxMeshLods];
+	
 	// very private
 	float* curVertex;
 	int* curIndex;
@@ -19,4 +30,5 @@ struct Mesh {
 	float* curNormal;
 };
 
+// Reentrant, several meshes may be loaded on different threads at once
 Mesh* loadObj(const char* filename);
@@ -0,0 +1,420 @@
+#include "pch.h"
+
+#include "ParticleSystem.h"
+#include "AssetCache.h"
+#include "Memory.h"
+#include "Profiler.h"
+#include "Counters.h"
+#include "Jobs.h"
+
+#include <Kore/Math/Random.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PARTICLES_SSE
+#endif
+
+using namespace Kore;
+
+namespace {
+	// Particles per job when updating
+	const int updateChunkSize = 1024;
+	
+	// The quads are 0.4 units wide
+	const float particleSize = 0.2f;
+	
+	void setVertex(float* vertices, int index, float x, float y, float z, float u, float v) {
+		vertices[index* 8 + 0] = x;
+		vertices[index*8 + 1] = y;
+		vertices[index*8 + 2] = z;
+		vertices[index*8 + 3] = u;
+		vertices[index*8 + 4] = v;
+		vertices[index*8 + 5] = 0.0f;
+		vertices[index*8 + 6] = 0.0f;
+		vertices[index*8 + 7] = -1.0f;
+	}
+}
+
+ParticleSystem::ParticleSystem(int maxParticles, int maxEmitters, const Graphics4::VertexStructure& structure, ShaderProgram* shaderProgram) : shaderProgram(shaderProgram), numBatches(0), stepTime(0), numParticles(maxParticles), numEmitters(0), maxEmitters(maxEmitters) {
+	positionX = Memory::allocate<float>(maxParticles, Memory::TagParticles);
+	positionY = Memory::allocate<float>(maxParticles, Memory::TagParticles);
+	positionZ = Memory::allocate<float>(maxParticles, Memory::TagParticles);
+	velocityX = Memory::allocate<float>(maxParticles, Memory::TagParticles);
+	velocityY = Memory::allocate<float>(maxParticles, Memory::TagParticles);
+	velocityZ = Memory::allocate<float>(maxParticles, Memory::TagParticles);
+	timeToLive = Memory::allocate<float>(maxParticles, Memory::TagParticles);
+	totalTimeToLive = Memory::allocate<float>(maxParticles, Memory::TagParticles);
+	dead = Memory::allocate<unsigned char>(maxParticles, Memory::TagParticles);
+	emitter = Memory::allocate<unsigned short>(maxParticles, Memory::TagParticles);
+	emitters = Memory::allocate<ParticleEmitter>(maxEmitters, Memory::TagParticles);
+	
+	vb = new Graphics4::VertexBuffer(4, structure,0);
+	float* vertices = vb->lock();
+	setVertex(vertices, 0, -1, -1, 0, 0, 0);
+	setVertex(vertices, 1, -1, 1, 0, 0, 1);
+	setVertex(vertices, 2, 1, 1, 0, 1, 1);
+	setVertex(vertices, 3, 1, -1, 0, 1, 0);
+	vb->unlock();
+
+	// Set index buffer
+	ib = new Graphics4::IndexBuffer(6);
+	int* indices = ib->lock();
+	indices[0] = 0;
+	indices[1] = 1;
+	indices[2] = 2;
+	indices[3] = 0;
+	indices[4] = 2;
+	indices[5] = 3;
+	ib->unlock();
+	
+	numAlive = 0;
+	maxAlive = maxParticles;
+	spawnScale = 1.0f;
+	
+	collisions.enabled = false;
+	collisions.response = Bounce;
+	collisions.restitution = 0.5f;
+	collisions.radius = 0.05f;
+}
+
+Graphics4::VertexStructure& ParticleSystem::instanceStructure() {
+	static Graphics4::VertexStructure structure;
+	static bool initialized = false;
+	if (!initialized) {
+		structure.add("instance", Graphics4::Float4VertexData);
+		structure.add("instanceTint", Graphics4::Float4VertexData);
+		structure.instanced = true;
+		initialized = true;
+	}
+	return structure;
+}
+
+void ParticleEmitter::setPosition(const Kore::vec3& inPosition, float distance) {
+	position = inPosition;
+
+	emitMin = position - vec3(distance, distance, distance);
+	emitMax = position + vec3(distance, distance, distance);
+}
+
+int ParticleSystem::addEmitter(const vec3& position, TextureHandle* texture) {
+	assert(numEmitters < maxEmitters);
+	
+	ParticleEmitter& e = emitters[numEmitters];
+	e.setPosition(position);
+	e.velocity = vec3(0, 0.3f, 0);
+	e.lifetime = 3.0f;
+	e.colorStart = vec4(2.5f, 0, 0, 1);
+	e.colorEnd = vec4(0, 0, 0, 0);
+	e.spawnRate = 0.05f;
+	e.nextSpawn = e.spawnRate;
+	e.budget = numParticles;
+	e.alive = 0;
+	e.texture = texture;
+	return numEmitters++;
+}
+
+void ParticleSystem::updateRange(int start, int end, void* param) {
+	ParticleSystem* system = (ParticleSystem*)param;
+	float deltaTime = system->stepTime;
+	float* positionX = system->positionX;
+	float* positionY = system->positionY;
+	float* positionZ = system->positionZ;
+	const float* velocityX = system->velocityX;
+	const float* velocityY = system->velocityY;
+	const float* velocityZ = system->velocityZ;
+	float* timeToLive = system->timeToLive;
+	unsigned char* dead = system->dead;
+	
+	// Note: We are using no forces or gravity at the moment.
+	for (int i = start; i < end; i++) {
+		timeToLive[i] -= deltaTime;
+		positionX[i] += velocityX[i] * deltaTime;
+		positionY[i] += velocityY[i] * deltaTime;
+		positionZ[i] += velocityZ[i] * deltaTime;
+		dead[i] = timeToLive[i] < 0.0f ? 1 : 0;
+	}
+}
+
+void ParticleSystem::update(float deltaTime) {
+	PROFILE_ZONE("ParticleSystem::update");
+	
+	// Do the emitters need to spawn a particle?
+	for (int e = 0; e < numEmitters; ++e) {
+		ParticleEmitter& current = emitters[e];
+		current.nextSpawn -= deltaTime;
+		if (current.nextSpawn >= 0) continue;
+		current.nextSpawn = current.spawnRate * spawnScale;
+		
+		// The pool is full, the cap was reached or the emitter used up its budget
+		if (numAlive >= maxAlive || numAlive >= numParticles || current.alive >= current.budget) {
+			Counters::add(Counters::ParticlesDropped);
+			continue;
+		}
+		EmitParticle(e);
+		Counters::add(Counters::ParticlesSpawned);
+	}
+	
+	// All living particles of all emitters in one pass
+	stepTime = deltaTime;
+	Jobs::parallelFor(numAlive, updateChunkSize, updateRange, this);
+	removeDead();
+}
+
+void ParticleSystem::removeDead() {
+	// Fill the hole with the last living particle, the order does not matter
+	int i = 0;
+	while (i < numAlive) {
+		if (!dead[i]) {
+			++i;
+			continue;
+		}
+		--emitters[emitter[i]].alive;
+		--numAlive;
+		positionX[i] = positionX[numAlive];
+		positionY[i] = positionY[numAlive];
+		positionZ[i] = positionZ[numAlive];
+		velocityX[i] = velocityX[numAlive];
+		velocityY[i] = velocityY[numAlive];
+		velocityZ[i] = velocityZ[numAlive];
+		timeToLive[i] = timeToLive[numAlive];
+		totalTimeToLive[i] = totalTimeToLive[numAlive];
+		dead[i] = dead[numAlive];
+		emitter[i] = emitter[numAlive];
+	}
+	Counters::set(Counters::ParticlesAlive, numAlive);
+}
+
+void ParticleSystem::respond(int i, float normalX, float normalY, float normalZ, float depth) {
+	Counters::add(Counters::ParticleCollisions);
+	
+	if (collisions.response == Kill) {
+		dead[i] = 1;
+		return;
+	}
+	
+	positionX[i] += normalX * depth;
+	positionY[i] += normalY * depth;
+	positionZ[i] += normalZ * depth;
+	
+	if (collisions.response == Stick) {
+		velocityX[i] = velocityY[i] = velocityZ[i] = 0;
+		return;
+	}
+	
+	// Reflect the part of the velocity that goes into the collider
+	float normalVelocity = velocityX[i] * normalX + velocityY[i] * normalY + velocityZ[i] * normalZ;
+	if (normalVelocity >= 0) return;
+	float change = -(1.0f + collisions.restitution) * normalVelocity;
+	velocityX[i] += normalX * change;
+	velocityY[i] += normalY * change;
+	velocityZ[i] += normalZ * change;
+}
+
+void ParticleSystem::collide(const PlaneCollider& plane, const SpatialHash& bodies) {
+	if (!collisions.enabled) return;
+	PROFILE_ZONE("ParticleSystem::collide");
+	
+	float radius = collisions.radius;
+	float normalX = plane.normal.x();
+	float normalY = plane.normal.y();
+	float normalZ = plane.normal.z();
+	
+	// The plane, 4 particles per step where SSE is available
+	int i = 0;
+#ifdef PARTICLES_SSE
+	for (; i + 4 <= numAlive; i += 4) {
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&positionX[i]), _mm_set1_ps(normalX)), _mm_mul_ps(_mm_loadu_ps(&positionY[i]), _mm_set1_ps(normalY))),
+		                             _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&positionZ[i]), _mm_set1_ps(normalZ)), _mm_set1_ps(plane.d)));
+		int mask = _mm_movemask_ps(_mm_cmplt_ps(distance, _mm_set1_ps(radius)));
+		if (mask == 0) continue;
+		
+		float distances[4];
+		_mm_storeu_ps(distances, distance);
+		for (int j = 0; j < 4; ++j) {
+			if ((mask & (1 << j)) && !dead[i + j]) respond(i + j, normalX, normalY, normalZ, radius - distances[j]);
+		}
+	}
+#endif
+	for (; i < numAlive; ++i) {
+		float distance = positionX[i] * normalX + positionY[i] * normalY + positionZ[i] * normalZ + plane.d;
+		if (distance < radius && !dead[i]) respond(i, normalX, normalY, normalZ, radius - distance);
+	}
+	
+	// The bodies, only the ones in the bucket of the particle are tested
+	for (i = 0; i < numAlive && bodies.size() > 0; ++i) {
+		if (dead[i]) continue;
+		
+		const int* candidates;
+		int count = bodies.query(positionX[i], positionY[i], positionZ[i], candidates);
+		for (int j = 0; j < count; ++j) {
+			int body = candidates[j];
+			float dx = positionX[i] - bodies.centerX[body];
+			float dy = positionY[i] - bodies.centerY[body];
+			float dz = positionZ[i] - bodies.centerZ[body];
+			float reach = bodies.radius[body] + radius;
+			float distanceSquared = dx * dx + dy * dy + dz * dz;
+			if (distanceSquared >= reach * reach || distanceSquared == 0) continue;
+			
+			float distance = sqrtf(distanceSquared);
+			respond(i, dx / distance, dy / distance, dz / distance, reach - distance);
+			if (dead[i]) break;
+		}
+	}
+	
+	// Killed by a collision
+	removeDead();
+}
+
+int ParticleSystem::getStates(State* states) const {
+	for (int i = 0; i < numAlive; i++) {
+		// Interpolate linearly between the two colors
+		const ParticleEmitter& source = emitters[emitter[i]];
+		float interpolation = timeToLive[i] / totalTimeToLive[i];
+		states[i].position = vec3(positionX[i], positionY[i], positionZ[i]);
+		states[i].tint = source.colorStart * interpolation + source.colorEnd * (1.0f - interpolation);
+		states[i].texture = source.texture;
+	}
+	return numAlive;
+}
+
+ParticleSystem::Batch* ParticleSystem::getBatch(TextureHandle* texture) {
+	for (int i = 0; i < numBatches; ++i) {
+		if (batches[i].texture == texture) return &batches[i];
+	}
+	
+	assert(numBatches < maxBatches);
+	if (numBatches >= maxBatches) return nullptr;
+	
+	Batch& batch = batches[numBatches++];
+	batch.texture = texture;
+	batch.instanceBuffer = new Graphics4::VertexBuffer(numParticles, instanceStructure(), 1);
+	batch.data = nullptr;
+	batch.count = 0;
+	batch.depth = 0;
+	return &batch;
+}
+
+void ParticleSystem::render(RenderQueue& queue, SceneParameters parameters, Frustum& frustum, const State* states, int count) {
+	PROFILE_ZONE("ParticleSystem::render");
+	
+	// Cull all particles at once
+	float* x = Memory::frameAllocate<float>(count);
+	float* y = Memory::frameAllocate<float>(count);
+	float* z = Memory::frameAllocate<float>(count);
+	float* radius = Memory::frameAllocate<float>(count);
+	unsigned char* visible = Memory::frameAllocate<unsigned char>(count);
+	for (int i = 0; i < count; i++) {
+		x[i] = states[i].position.x();
+		y[i] = states[i].position.y();
+		z[i] = states[i].position.z();
+		radius[i] = particleSize * 1.4143f;
+	}
+	frustum.cullSpheres(x, y, z, radius, count, visible);
+	
+	// The particles are blended without writing depth, so they have to be drawn back to front.
+	// The keys hold the inverted view depth in the upper half (positive floats order like their bits) and the particle below.
+	unsigned long long* keys = Memory::frameAllocate<unsigned long long>(count);
+	int numVisible = 0;
+	for (int i = 0; i < count; i++) {
+		if (!visible[i] || !states[i].texture->isReady()) continue;
+		float depth = (parameters.PV * vec4(x[i], y[i], z[i], 1)).w();
+		if (depth < 0) depth = 0;
+		unsigned bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		keys[numVisible++] = (unsigned long long)~bits << 32 | (unsigned)i;
+	}
+	std::sort(keys, keys + numVisible);
+	
+	/************************************************************************/
+	/* Exercise P8.1														*/
+	/************************************************************************/
+	/* Change the matrix V in such a way that the billboards are oriented towards the camera */
+
+	/** This is the alternative solution */
+	/*parameters.V = parameters.V.Invert();
+	parameters.V.Set(0, 3, 0.0f);
+	parameters.V.Set(1, 3, 0.0f);
+	parameters.V.Set(2, 3, 0.0f);*/
+	
+	parameters.V = parameters.V.Transpose3x3();
+
+	/************************************************************************/
+	/* Exercise P8.2														*/
+	/************************************************************************/
+	/* Animate using at least one new control parameter */
+
+	// Sort the visible particles into the batches of their textures, keeping the order
+	Batch* batch = nullptr;
+	for (int k = 0; k < numVisible; k++) {
+		int i = (int)(keys[k] & 0xffffffff);
+		
+		if (batch == nullptr || batch->texture != states[i].texture) {
+			batch = getBatch(states[i].texture);
+			if (batch == nullptr) continue;
+		}
+		if (batch->data == nullptr) {
+			batch->data = batch->instanceBuffer->lock();
+			batch->count = 0;
+			// The first particle is the farthest one
+			unsigned bits = ~(unsigned)(keys[k] >> 32);
+			memcpy(&batch->depth, &bits, sizeof(bits));
+		}
+		
+		float* instance = &batch->data[batch->count * 8];
+		instance[0] = states[i].position.x();
+		instance[1] = states[i].position.y();
+		instance[2] = states[i].position.z();
+		instance[3] = particleSize;
+		instance[4] = states[i].tint.x();
+		instance[5] = states[i].tint.y();
+		instance[6] = states[i].tint.z();
+		instance[7] = states[i].tint.w();
+		++batch->count;
+	}
+	
+	// The billboard rotation is the same for all particles, M carries it. The batches are ordered by their farthest particle.
+	for (int i = 0; i < numBatches; ++i) {
+		Batch& current = batches[i];
+		if (current.data == nullptr) continue;
+		current.instanceBuffer->unlock();
+		current.data = nullptr;
+		Counters::add(Counters::BytesUploaded, current.count * 8 * sizeof(float));
+		queue.submitInstanced(shaderProgram, current.texture->texture, vb, ib, current.instanceBuffer, current.count, parameters.V, parameters.tint, current.depth);
+	}
+}
+
+float ParticleSystem::getRandom(float minValue, float maxValue) {
+	int randMax = 1000000;
+	int randInt = Random::get(0, randMax);
+	float r =  (float) randInt / (float) randMax;
+	return minValue + r * (maxValue - minValue);
+}
+
+void ParticleSystem::EmitParticle(int emitterIndex) {
+	ParticleEmitter& source = emitters[emitterIndex];
+	int index = numAlive++;
+	
+	// Calculate a random position inside the box
+	float x = getRandom(source.emitMin.x(), source.emitMax.x());
+	float y = getRandom(source.emitMin.y(), source.emitMax.y());
+	float z = getRandom(source.emitMin.z(), source.emitMax.z());
+
+	positionX[index] = x;
+	positionY[index] = y;
+	positionZ[index] = z;
+
+	velocityX[index] = source.velocity.x();
+	velocityY[index] = source.velocity.y();
+	velocityZ[index] = source.velocity.z();
+	
+	timeToLive[index] = source.lifetime;
+	totalTimeToLive[index] = source.lifetime;
+	dead[index] = 0;
+	emitter[index] = (unsigned short)emitterIndex;
+	++source.alive;
+}
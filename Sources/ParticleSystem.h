@@ -0,0 +1,188 @@
+#pragma once
+
+#include <Kore/Graphics4/Graphics.h>
+#include <Kore/Math/Vector.h>
+#include <Kore/Math/Matrix.h>
+
+#include "ShaderProgram.h"
+#include "AssetLoader.h"
+#include "RenderQueue.h"
+#include "Frustum.h"
+#include "Collision.h"
+#include "SpatialHash.h"
+
+using namespace Kore;
+
+// Describes how particles are spawned. An emitter owns no particles, they all live in the pool of the ParticleSystem.
+struct ParticleEmitter {
+	// The center of the emitter
+	vec3 position;
+	
+	// The minimum coordinates of the emitter box
+	vec3 emitMin;
+	
+	// The maximal coordinates of the emitter box
+	vec3 emitMax;
+	
+	// The velocity of new particles
+	vec3 velocity;
+	
+	// The time to live of new particles
+	float lifetime;
+	
+	/************************************************************************/
+	/* Solution - Simulate fire by interpolating colors over lifetime       */
+	/************************************************************************/
+	// The beginning color
+	vec4 colorStart;
+	
+	// The end color
+	vec4 colorEnd;
+	
+	// The spawn rate
+	float spawnRate;
+	
+	// When should the next particle be spawned?
+	float nextSpawn;
+	
+	// No particles are spawned for this emitter while this many of them are alive
+	int budget;
+	
+	// The number of living particles of this emitter after the last update
+	int alive;
+	
+	TextureHandle* texture;
+	
+	void setPosition(const Kore::vec3& inPosition, float distance = 0.1f);
+};
+
+// Emits and simulates the particles of all emitters in one pool. update() may run on another thread than render(),
+// the render thread only sees the particles through the states written by getStates().
+// The living particles are kept at the front of one array per attribute, so that a single pass over them
+// can be split between the worker threads and update and collide process several at once.
+class ParticleSystem {
+private:
+	ShaderProgram* shaderProgram;
+	
+	// One quad for all particles
+	Graphics4::VertexBuffer* vb;
+	Graphics4::IndexBuffer* ib;
+	
+	// The particles of one texture are drawn with one instanced draw call, back to front
+	struct Batch {
+		TextureHandle* texture;
+		Graphics4::VertexBuffer* instanceBuffer;
+		float* data;
+		int count;
+		// The view depth of the farthest particle
+		float depth;
+	};
+	
+	static const int maxBatches = 8;
+	Batch batches[maxBatches];
+	int numBatches;
+	
+	// The batch of texture, which is added when it is new
+	Batch* getBatch(TextureHandle* texture);
+	
+	float stepTime;
+	
+	// Integrate the particles in [start, end)
+	static void updateRange(int start, int end, void* param);
+	
+	// Move the particles that died to the back
+	void removeDead();
+	
+	// Push particle i out of a collider along normal, which points away from the collider
+	void respond(int i, float normalX, float normalY, float normalZ, float depth);
+
+public:
+	// What the render thread needs to know about a living particle
+	struct State {
+		vec3 position;
+		vec4 tint;
+		TextureHandle* texture;
+	};
+	
+	// What happens to a particle that hits the ground or a body
+	enum CollisionResponse {
+		Bounce,
+		Stick,
+		Kill
+	};
+	
+	struct CollisionSettings {
+		bool enabled;
+		CollisionResponse response;
+		// The part of the velocity towards the collider that is kept when bouncing
+		float restitution;
+		// Particles collide as spheres of this radius
+		float radius;
+	};
+	
+	// The current positions
+	float* positionX;
+	float* positionY;
+	float* positionZ;
+	
+	// The current velocities
+	float* velocityX;
+	float* velocityY;
+	float* velocityZ;
+	
+	// The remaining time to live
+	float* timeToLive;
+	
+	// The total time time to live
+	float* totalTimeToLive;
+	
+	// Did the particle die in this step? Only set while updating and colliding
+	unsigned char* dead;
+	
+	// The emitter that spawned the particle
+	unsigned short* emitter;
+	
+	// The size of the pool
+	int numParticles;
+	
+	// The living particles are the first numAlive ones
+	int numAlive;
+	
+	// No particles are spawned while this many are alive
+	int maxAlive;
+	
+	// Multiplies the spawn rates (the seconds between two spawns) of all emitters
+	float spawnScale;
+	
+	ParticleEmitter* emitters;
+	int numEmitters;
+	int maxEmitters;
+	
+	// Collisions are off by default
+	CollisionSettings collisions;
+	
+	ParticleSystem(int maxParticles, int maxEmitters, const Graphics4::VertexStructure& structure, ShaderProgram* shaderProgram);
+	
+	// The per instance vertex data: position in xyz and size in w of instance, then the tint
+	static Graphics4::VertexStructure& instanceStructure();
+	
+	// Add an emitter at position that spawns red fading particles, returns its index. Call before the simulation starts.
+	int addEmitter(const vec3& position, TextureHandle* texture);
+	
+	void update(float deltaTime);
+	
+	// Collide the living particles with the plane and the spheres in bodies, after update.
+	// bodies has to be built with collisions.radius as its query radius.
+	void collide(const PlaneCollider& plane, const SpatialHash& bodies);
+	
+	// Write the living particles to states (room for numParticles), returns their number
+	int getStates(State* states) const;
+	
+	// Queue the given particles, one instanced draw per texture.
+	// Needs a ShaderProgram that was created with instanceStructure() (e.g. shader_particle.vert).
+	void render(RenderQueue& queue, SceneParameters parameters, Frustum& frustum, const State* states, int count);
+	
+	float getRandom(float minValue, float maxValue);
+	
+	void EmitParticle(int emitterIndex);
+};
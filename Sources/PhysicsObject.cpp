@@ -1,5 +1,6 @@
 #include "PhysicsObject.h"
 #include "Kore/Log.h"
+#include "Counters.h"
 
 using namespace Kore;
 
@@ -9,85 +10,89 @@ PhysicsObject::PhysicsObject() {
 	Accumulator = vec3(0, 0, 0);
 	Velocity = vec3(0, 0, 0);
 	Collider.radius = 0.1f;
+	Scale = 0.2f;
 	id = ++currentID;
 }
 
 void PhysicsObject::HandleCollision(const PlaneCollider& collider, float deltaT) {
 	 // Check if we are colliding with the plane
-	if (Collider.IntersectsWith(collider)) {
+	Contact contact;
+	if (GenerateContact(GetShape(), MakeShape(collider), contact)) {
+		Counters::add(Counters::NarrowphaseHits);
+		ResolveContact(contact, nullptr);
+	}
+}
+
 
+void PhysicsObject::HandleCollision(PhysicsObject* other, float deltaT) {
+	// Check if we are colliding with the other object
+	Contact contact;
+	if (GenerateContact(GetShape(), other->GetShape(), contact)) {
+		Counters::add(Counters::NarrowphaseHits);
+		ResolveContact(contact, other);
+	}
+}
+
+
+void PhysicsObject::ResolveContact(const Contact& contact, PhysicsObject* other) {
+	float restitution = 0.8f;
+	
+	if (other == nullptr) {
 		// Kore::log(Info, "Floor");
-		float restitution = 0.8f;
+		
+		// The static collider pushes back against the contact normal
+		vec3 normal = contact.normal * -1.0f;
 
 		// Calculate the separating velocity
-		float separatingVelocity = -(collider.normal * Velocity);
+		float separatingVelocity = -(normal * Velocity);
 
 		if (separatingVelocity < 0) return;
 		
 		// Calculate a new one, based on the old one and the restitution
 		float newSeparatingVelocity = -separatingVelocity * restitution;
 
-			
-		// Move the object out of the collider
-		float penetrationDepth = Collider.PenetrationDepth(collider); 
-		//Position += collider.normal * -penetrationDepth;
-		//SetPosition(Position);
-
-		bool Result = Collider.IntersectsWith(collider);
-
 		// Calculate the impulse
-		// The plane is immovable, so we have to move all the way
+		// The collider is immovable, so we have to move all the way
 		float deltaVelocity = newSeparatingVelocity - separatingVelocity;
 
 		// If the object is very slow, assume resting contact
 		if (deltaVelocity > -1.5f) {
+			Counters::add(Counters::ContactsResolved);
 			Velocity.set(0, 0, 0);
-			Position = vec3(Position.x(), Collider.radius - collider.d, Position.z());
-			Collider.center = Position;
+			SetPosition(Position + normal * contact.depth);
 			return;
 		}
 
 		// Apply the impulse
-		vec3 impulse = collider.normal * -deltaVelocity;
+		vec3 impulse = normal * -deltaVelocity;
 
 		ApplyImpulse(impulse);
+		Counters::add(Counters::ContactsResolved);
+		return;
 	}
-}
-
-
-void PhysicsObject::HandleCollision(PhysicsObject* other, float deltaT) {
-	// Check if we are colliding with the plane
-	if (Collider.IntersectsWith(other->Collider)) {
-
-		// Kore::log(Info, "Intersection");
-
-		float restitution = 0.8f;
-
-		vec3 collisionNormal = Collider.GetCollisionNormal(other->Collider);
-			
-		float separatingVelocity = -(other->Velocity - Velocity) * collisionNormal;
-
-		// If we are already separating: Nothing to do
-		if (separatingVelocity < 0) return;
+	
+	// Kore::log(Info, "Intersection");
+	
+	const vec3& collisionNormal = contact.normal;
+		
+	float separatingVelocity = -(other->Velocity - Velocity) * collisionNormal;
 
-		float newSeparatingVelocity = -separatingVelocity * restitution;
+	// If we are already separating: Nothing to do
+	if (separatingVelocity < 0) return;
 
-		float deltaVelocity = newSeparatingVelocity - separatingVelocity;
-			
-		// Move the object out of the collider
-		float penetrationDepth = -Collider.PenetrationDepth(other->Collider);
-		
-		// We share the position change equally
-		SetPosition(Position + collisionNormal * penetrationDepth *0.5f);
-		other->SetPosition(other->Position - collisionNormal * penetrationDepth * 0.5f);
+	float newSeparatingVelocity = -separatingVelocity * restitution;
 
-		bool Result = Collider.IntersectsWith(other->Collider);
+	float deltaVelocity = newSeparatingVelocity - separatingVelocity;
+	
+	// Move the objects out of each other, we share the position change equally
+	SetPosition(Position - collisionNormal * contact.depth * 0.5f);
+	other->SetPosition(other->Position + collisionNormal * contact.depth * 0.5f);
 
-		vec3 impulse = collisionNormal * -deltaVelocity;
+	vec3 impulse = collisionNormal * -deltaVelocity;
 
-		ApplyImpulse(-impulse);
-		other->ApplyImpulse(impulse);
-	}
+	ApplyImpulse(-impulse);
+	other->ApplyImpulse(impulse);
+	Counters::add(Counters::ContactsResolved);
 }
 
 
@@ -104,25 +109,14 @@ void PhysicsObject::Integrate(float deltaT) {
 	/************************************************************************/
 	/* Exercise P8.3														*/
 	/************************************************************************/
-	/* Implement an Euler integrator here */
+	/* Implement an Euler integrator here (see ExplicitEuler and PerStepDamping in Integrators.h) */
 	
-	// Derive a new position based on the velocity (Note: Use SetPosition to also set the collider's values)
-	SetPosition(Position + Velocity * deltaT);
-
-	// Derive a new Velocity based on the accumulated forces
-	Velocity += (Accumulator / Mass) * deltaT;
-
-	// Multiply by a damping coefficient (e.g. 0.98)
-	float damping = 0.98f;
-	Velocity *= damping;
-
-	// Clear the accumulator
-	Accumulator = vec3(0, 0, 0);
+	Integrate<PhysicsIntegrator, PhysicsDamping>(deltaT);
 }
 
 void PhysicsObject::UpdateMatrix() {
 	// Update the Mesh matrix
-	Mesh->M = mat4::Translation(Position.x(), Position.y(), Position.z()) * mat4::Scale(0.2f, 0.2f, 0.2f);
+	Mesh->M = mat4::Translation(Position.x(), Position.y(), Position.z()) * mat4::Scale(Scale, Scale, Scale);
 }
 
 
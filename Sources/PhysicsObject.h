@@ -8,6 +8,11 @@
 #include "Memory.h"
 #include "Collision.h"
 #include "MeshObject.h"
+#include "Integrators.h"
+
+// The integration scheme of all objects, resolved at compile time (see Integrators.h)
+typedef SymplecticEuler PhysicsIntegrator;
+typedef ExponentialDamping PhysicsDamping;
 
 // A physically simulated object
 class PhysicsObject {
@@ -33,13 +38,31 @@ class PhysicsObject {
 	
 	SphereCollider Collider;
 	
+	ColliderShape GetShape() const {
+		return MakeShape(Collider);
+	}
+	
 	MeshObject* Mesh;
 	
+	// The scale of the mesh
+	float Scale;
+	
 	PhysicsObject();
 	
 	// Do the integration step for the equations of motion
 	void Integrate(float deltaT);
 	
+	template<class Integrator, class Damping> void Integrate(float deltaT) {
+		vec3 position = Position;
+		Integrator::Step(position, Velocity, Accumulator / Mass, deltaT);
+		SetPosition(position);
+		
+		Velocity *= Damping::Factor(deltaT);
+		
+		// Clear the accumulator
+		Accumulator = vec3(0, 0, 0);
+	}
+	
 	// Apply a force that acts along the center of mass
 	void ApplyForceToCenter(vec3 force);
 	
@@ -52,6 +75,9 @@ class PhysicsObject {
 	// Handle the collision with another sphere (includes testing for intersection)
 	void HandleCollision(PhysicsObject* other, float deltaT);
 	
+	// Respond to a contact whose normal points away from this object, other is nullptr for static colliders
+	void ResolveContact(const Contact& contact, PhysicsObject* other);
+	
 	// Update the matrix of the mesh
 	void UpdateMatrix();
 	
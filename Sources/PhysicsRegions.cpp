@@ -0,0 +1,237 @@
+#include "pch.h"
+
+#include "PhysicsRegions.h"
+#include "PhysicsObject.h"
+#include "Jobs.h"
+#include "Profiler.h"
+#include "Counters.h"
+#include "Memory.h"
+
+#include <math.h>
+
+using namespace Kore;
+
+PhysicsRegions::PhysicsRegions(float regionSize, int regionsX, int regionsZ)
+	: ghostMargin(0.5f), regionSize(regionSize), regionsX(regionsX), regionsZ(regionsZ), stepTime(0) {
+	regions = new PhysicsWorld[regionsX * regionsZ];
+}
+
+int PhysicsRegions::cellX(float x) const {
+	int cell = (int)floorf(x / regionSize + regionsX * 0.5f);
+	return cell < 0 ? 0 : (cell >= regionsX ? regionsX - 1 : cell);
+}
+
+int PhysicsRegions::cellZ(float z) const {
+	int cell = (int)floorf(z / regionSize + regionsZ * 0.5f);
+	return cell < 0 ? 0 : (cell >= regionsZ ? regionsZ - 1 : cell);
+}
+
+int PhysicsRegions::RegionOf(const vec3& position) const {
+	return cellZ(position.z()) * regionsX + cellX(position.x());
+}
+
+void PhysicsRegions::AddObject(PhysicsObject* po) {
+	regions[RegionOf(po->GetPosition())].AddObject(po);
+}
+
+void PhysicsRegions::RemoveObject(PhysicsObject* po) {
+	for (int r = 0; r < RegionCount(); ++r) {
+		PhysicsObject** objects = regions[r].physicsObjects;
+		for (int i = 0; objects[i] != nullptr; ++i) {
+			if (objects[i] == po) {
+				regions[r].RemoveObject(po);
+				return;
+			}
+		}
+	}
+}
+
+int PhysicsRegions::Count() const {
+	int count = 0;
+	for (int r = 0; r < RegionCount(); ++r) {
+		count += regions[r].Count();
+	}
+	return count;
+}
+
+int PhysicsRegions::Gather(PhysicsObject** objects) const {
+	int count = 0;
+	for (int r = 0; r < RegionCount(); ++r) {
+		for (PhysicsObject** currentP = regions[r].physicsObjects; *currentP != nullptr; ++currentP) {
+			objects[count++] = *currentP;
+		}
+	}
+	return count;
+}
+
+void PhysicsRegions::buildGhosts() {
+	PROFILE_ZONE("Ghosts");
+	
+	for (int r = 0; r < RegionCount(); ++r) {
+		regions[r].ClearGhosts();
+	}
+	
+	for (int r = 0; r < RegionCount(); ++r) {
+		for (PhysicsObject** currentP = regions[r].physicsObjects; *currentP != nullptr; ++currentP) {
+			PhysicsObject* po = *currentP;
+			vec3 position = po->GetPosition();
+			float reach = po->Collider.radius + ghostMargin;
+			
+			// Every region the grown bounds touch sees the body
+			int minX = cellX(position.x() - reach);
+			int maxX = cellX(position.x() + reach);
+			int minZ = cellZ(position.z() - reach);
+			int maxZ = cellZ(position.z() + reach);
+			for (int z = minZ; z <= maxZ; ++z) {
+				for (int x = minX; x <= maxX; ++x) {
+					int neighbour = z * regionsX + x;
+					if (neighbour != r) regions[neighbour].AddGhost(*po);
+				}
+			}
+		}
+	}
+}
+
+void PhysicsRegions::integrateRange(int start, int end, void* param) {
+	PhysicsRegions* self = (PhysicsRegions*)param;
+	for (int r = start; r < end; ++r) {
+		self->regions[r].Integrate(self->stepTime);
+	}
+}
+
+void PhysicsRegions::collideRange(int start, int end, void* param) {
+	PhysicsRegions* self = (PhysicsRegions*)param;
+	for (int r = start; r < end; ++r) {
+		self->regions[r].HandleCollisions(self->stepTime);
+	}
+}
+
+void PhysicsRegions::handOff() {
+	PROFILE_ZONE("Handoff");
+	
+	for (int r = 0; r < RegionCount(); ++r) {
+		PhysicsObject** objects = regions[r].physicsObjects;
+		int i = 0;
+		while (objects[i] != nullptr) {
+			PhysicsObject* po = objects[i];
+			int target = RegionOf(po->GetPosition());
+			// A full region keeps the body out, it stays where it is until there is room
+			if (target == r || regions[target].Count() == PhysicsWorld::maxObjects) {
+				++i;
+				continue;
+			}
+			
+			// The removal keeps the order, so the next body moves to i
+			regions[r].RemoveObject(po);
+			regions[target].AddObject(po);
+		}
+	}
+}
+
+bool PhysicsRegions::Raycast(const vec3& origin, const vec3& direction, float maxDistance, PhysicsWorld::RaycastHit& hit) const {
+	hit.object = nullptr;
+	hit.distance = maxDistance;
+	for (int r = 0; r < RegionCount(); ++r) {
+		// Only hits closer than the best so far count
+		PhysicsWorld::RaycastHit regionHit;
+		if (regions[r].Raycast(origin, direction, hit.distance, regionHit) && (hit.object == nullptr || regionHit.distance < hit.distance)) {
+			hit = regionHit;
+		}
+	}
+	if (hit.object == nullptr) hit.point = origin + vec3(direction).normalize() * maxDistance;
+	return hit.object != nullptr;
+}
+
+void PhysicsRegions::Raycast(const SpatialIndex::Ray* rays, int count, PhysicsWorld::RaycastHit* hits) const {
+	Memory::StackScope scope(Memory::threadArena());
+	PhysicsWorld::RaycastHit* regionHits = Memory::threadArena().allocate<PhysicsWorld::RaycastHit>(count);
+	regions[0].Raycast(rays, count, hits);
+	for (int r = 1; r < RegionCount(); ++r) {
+		regions[r].Raycast(rays, count, regionHits);
+		for (int i = 0; i < count; ++i) {
+			if (regionHits[i].object != nullptr && (hits[i].object == nullptr || regionHits[i].distance < hits[i].distance)) {
+				hits[i] = regionHits[i];
+			}
+		}
+	}
+}
+
+int PhysicsRegions::OverlapSphere(const vec3& center, float radius, PhysicsObject** results, int maxResults) const {
+	int found = 0;
+	for (int r = 0; r < RegionCount(); ++r) {
+		int room = found < maxResults ? maxResults - found : 0;
+		found += regions[r].OverlapSphere(center, radius, &results[found < maxResults ? found : maxResults], room);
+	}
+	return found;
+}
+
+int PhysicsRegions::OverlapAABB(const vec3& min, const vec3& max, PhysicsObject** results, int maxResults) const {
+	int found = 0;
+	for (int r = 0; r < RegionCount(); ++r) {
+		int room = found < maxResults ? maxResults - found : 0;
+		found += regions[r].OverlapAABB(min, max, &results[found < maxResults ? found : maxResults], room);
+	}
+	return found;
+}
+
+int PhysicsRegions::NearestK(const vec3& point, int k, PhysicsObject** results, float* distances) const {
+	if (k <= 0) return 0;
+	
+	Memory::StackScope scope(Memory::threadArena());
+	PhysicsObject** regionResults = Memory::threadArena().allocate<PhysicsObject*>(k);
+	float* regionDistances = Memory::threadArena().allocate<float>(k);
+	float* best = Memory::threadArena().allocate<float>(k);
+	int found = 0;
+	for (int r = 0; r < RegionCount(); ++r) {
+		int regionFound = regions[r].NearestK(point, k, regionResults, regionDistances);
+		
+		// Insert into the sorted list, the rest of the region is further away once one does not fit
+		for (int i = 0; i < regionFound; ++i) {
+			float distance = regionDistances[i];
+			if (found == k && distance >= best[k - 1]) break;
+			
+			int slot = found < k ? found++ : k - 1;
+			while (slot > 0 && best[slot - 1] > distance) {
+				best[slot] = best[slot - 1];
+				results[slot] = results[slot - 1];
+				--slot;
+			}
+			best[slot] = distance;
+			results[slot] = regionResults[i];
+		}
+	}
+	
+	if (distances != nullptr) {
+		for (int i = 0; i < found; ++i) {
+			distances[i] = best[i];
+		}
+	}
+	return found;
+}
+
+void PhysicsRegions::Update(float deltaT) {
+	PROFILE_ZONE("PhysicsRegions::Update");
+	
+	stepTime = deltaT;
+	Jobs::parallelFor(RegionCount(), 1, integrateRange, this);
+	
+	// From the integrated bodies, the same state their own region collides
+	buildGhosts();
+	
+	Jobs::parallelFor(RegionCount(), 1, collideRange, this);
+	
+	handOff();
+	
+	int total = 0;
+	int sleeping = 0;
+	for (int r = 0; r < RegionCount(); ++r) {
+		for (PhysicsObject** currentP = regions[r].physicsObjects; *currentP != nullptr; ++currentP) {
+			++total;
+			if ((*currentP)->Velocity.squareLength() == 0) ++sleeping;
+		}
+		regions[r].BuildIndex();
+	}
+	Counters::set(Counters::BodiesTotal, total);
+	Counters::set(Counters::BodiesAwake, total - sleeping);
+	Counters::set(Counters::BodiesSleeping, sleeping);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "pch.h"
+
+#include "PhysicsWorld.h"
+
+using namespace Kore;
+
+// Splits the simulation into a grid of PhysicsWorlds on the xz plane, which are stepped in parallel.
+// A step integrates all regions, then copies the bodies close to the border of a region as ghosts into the neighbours
+// and handles the collisions of all regions, so that both sides of a border collide the same integrated bodies.
+// Bodies that left their region are handed over after the step. Both happen in region and object order,
+// so the result does not depend on how the steps were spread over the threads.
+// At most PhysicsWorld::maxGhosts bodies of the neighbours may be close to the borders of one region.
+class PhysicsRegions {
+public:
+	// The grid is centered on the origin, positions outside of it belong to the closest region
+	PhysicsRegions(float regionSize, int regionsX, int regionsZ);
+	
+	// Integrate all regions, build the ghosts, collide all regions, then hand over the bodies and rebuild the indices
+	void Update(float deltaT);
+	
+	// Add an object to the region of its position
+	void AddObject(PhysicsObject* po);
+	
+	void RemoveObject(PhysicsObject* po);
+	
+	// The number of objects in all regions
+	int Count() const;
+	
+	// Write the objects of all regions to objects (room for Count()) ordered by region, returns their number
+	int Gather(PhysicsObject** objects) const;
+	
+	int RegionOf(const vec3& position) const;
+	
+	PhysicsWorld& Region(int i) {
+		return regions[i];
+	}
+	
+	int RegionCount() const {
+		return regionsX * regionsZ;
+	}
+	
+	// The ground plane, which is the same in all regions
+	const PlaneCollider& Plane() const {
+		return regions[0].plane;
+	}
+	
+	// The queries below merge the results of the indices of all regions, which see the bodies as they were at the end of Update.
+	// They only read the regions and may run on several threads at once while the regions are not updated.
+	
+	// The closest body hit by the ray, direction does not need to be normalized
+	bool Raycast(const vec3& origin, const vec3& direction, float maxDistance, PhysicsWorld::RaycastHit& hit) const;
+	
+	// Trace many rays at once, every region traces all of them in packets
+	void Raycast(const SpatialIndex::Ray* rays, int count, PhysicsWorld::RaycastHit* hits) const;
+	
+	// The bodies touching the sphere, returns their number (which may be larger than maxResults)
+	int OverlapSphere(const vec3& center, float radius, PhysicsObject** results, int maxResults) const;
+	
+	// The bodies touching the box, returns their number (which may be larger than maxResults)
+	int OverlapAABB(const vec3& min, const vec3& max, PhysicsObject** results, int maxResults) const;
+	
+	// The k bodies with the closest surfaces, sorted by distance. Returns the number found.
+	int NearestK(const vec3& point, int k, PhysicsObject** results, float* distances = nullptr) const;
+	
+	// Bodies closer than this (plus their radius) to a neighbour are ghosted into it
+	float ghostMargin;
+	
+private:
+	static void integrateRange(int start, int end, void* param);
+	static void collideRange(int start, int end, void* param);
+	
+	// Copy the bodies near the borders into the neighbours
+	void buildGhosts();
+	
+	// Move the bodies that left their region
+	void handOff();
+	
+	int cellX(float x) const;
+	int cellZ(float z) const;
+	
+	PhysicsRegions(const PhysicsRegions&);
+	PhysicsRegions& operator=(const PhysicsRegions&);
+	
+	PhysicsWorld* regions;
+	float regionSize;
+	int regionsX;
+	int regionsZ;
+	float stepTime;
+};
@@ -2,63 +2,292 @@
 
 #include "PhysicsWorld.h"
 #include "PhysicsObject.h"
+#include "Profiler.h"
+#include "Counters.h"
+#include "Memory.h"
+
+#include <assert.h>
+#include <new>
 
 
 using namespace Kore;
 
+namespace {
+	// The candidates object i has not been paired with yet, which are the objects after it and the ghosts.
+	// Returns their number, others may be nullptr to only count them.
+	int pairCandidates(const SpatialHash& broadphase, const vec3& center, int i, int* others) {
+		const int* candidates;
+		int count = broadphase.query(center.x(), center.y(), center.z(), candidates);
+		int found = 0;
+		for (int k = 0; k < count; ++k) {
+			int j = candidates[k];
+			// A sphere whose cells share the bucket is in it twice in a row
+			if (j <= i || (k > 0 && candidates[k - 1] == j)) continue;
+			if (others != nullptr) others[found] = j;
+			++found;
+		}
+		return found;
+	}
+}
 
-PhysicsWorld::PhysicsWorld() {
-	physicsObjects = new PhysicsObject*[100];
-		for (int i = 0; i < 100; i++) {
+PhysicsWorld::PhysicsWorld() : broadphase(maxObjects + maxGhosts, 1024, Memory::TagPhysics), index(maxObjects, Memory::TagPhysics) {
+	physicsObjects = new PhysicsObject*[maxObjects + 1];
+	indexed = new PhysicsObject*[maxObjects];
+		for (int i = 0; i <= maxObjects; i++) {
 			physicsObjects[i] = nullptr;
 		}
 
 		plane.normal = vec3(0, 1, 0);
 		plane.d = -1;
+		
+		contacts = nullptr;
+		numContacts = 0;
+		
+		// Ghosts are copy constructed in place, constructing them here would use up object ids
+		ghosts = (PhysicsObject*)::operator new(maxGhosts * sizeof(PhysicsObject));
+		numGhosts = 0;
+		numStaticColliders = 0;
+		AddStaticCollider(MakeShape(plane));
 }
 
 
 void PhysicsWorld::Update(float deltaT) {
+	PROFILE_ZONE("PhysicsWorld::Update");
+	
+	Step(deltaT);
+	
+	// Resting objects have their velocity cleared
+	int total = 0;
+	int sleeping = 0;
+	for (PhysicsObject** currentP = &physicsObjects[0]; *currentP != nullptr; ++currentP) {
+		++total;
+		if ((*currentP)->Velocity.squareLength() == 0) ++sleeping;
+	}
+	Counters::set(Counters::BodiesTotal, total);
+	Counters::set(Counters::BodiesAwake, total - sleeping);
+	Counters::set(Counters::BodiesSleeping, sleeping);
+	
+	BuildIndex();
+}
+
+void PhysicsWorld::Step(float deltaT) {
+	Integrate(deltaT);
+	HandleCollisions(deltaT);
+}
+
+void PhysicsWorld::Integrate(float deltaT) {
+	PROFILE_ZONE("Integrate");
+	
 	PhysicsObject** currentP = &physicsObjects[0];
-		while (*currentP != nullptr) {
+	while (*currentP != nullptr) {
 
 		// Apply gravity (= constant accceleration, so we multiply with the mass and divide in the integration step.
 		// The alternative would be to add gravity during the integration as a constant.
 
 		(*currentP)->ApplyForceToCenter(vec3(0, (*currentP)->Mass * -9.81, 0));
 		
-		// Integrate the equations of motion
-		(*currentP)->Integrate(deltaT);
+		// Integrate the equations of motion, inlined for the policies chosen in PhysicsObject.h
+		(*currentP)->Integrate<PhysicsIntegrator, PhysicsDamping>(deltaT);
 		++currentP;
 	}
+}
 
-		currentP = &physicsObjects[0];
-		while (*currentP != nullptr) {
-			// Check for collisions with the plane
-			(*currentP)->HandleCollision(plane, deltaT);
-
-			++currentP;
-		}
-
-		currentP = &physicsObjects[0];
-		while (*currentP != nullptr) {
-
-			// Check for collisions with the other objects
-			PhysicsObject** currentCollision = currentP + 1;
-			while (*currentCollision != nullptr) {
 
-				(*currentP)->HandleCollision(*currentCollision, deltaT);
-				++currentCollision;
-			}
-			++currentP;
-		}
+void PhysicsWorld::AddGhost(const PhysicsObject& po) {
+	assert(numGhosts < maxGhosts);
+	if (numGhosts >= maxGhosts) return;
+	new (&ghosts[numGhosts++]) PhysicsObject(po);
 }
 
+void PhysicsWorld::ClearGhosts() {
+	numGhosts = 0;
+}
 
 void PhysicsWorld::AddObject(PhysicsObject* po) {
 	PhysicsObject** current = &physicsObjects[0];
 	while (*current != nullptr) {
 		++current;
 	} 
+	assert(current - physicsObjects < maxObjects);
 	*current = po;
 }
+
+void PhysicsWorld::RemoveObject(PhysicsObject* po) {
+	PhysicsObject** current = &physicsObjects[0];
+	while (*current != nullptr && *current != po) {
+		++current;
+	}
+	if (*current == nullptr) return;
+	
+	// Move the following objects (and the terminating nullptr) one slot forward
+	do {
+		current[0] = current[1];
+		++current;
+	} while (*current != nullptr);
+}
+
+void PhysicsWorld::HandleCollisions(float deltaT) {
+	int count = Count();
+	int total = count + numGhosts;
+	
+	Memory::StackAllocator& arena = Memory::threadArena();
+	Memory::StackScope scope(arena);
+	
+	{
+		PROFILE_ZONE("Generate contacts");
+		
+		// Index i is object i, count + i ghost i. The queries are centered on the objects,
+		// so the spheres are grown by the largest object radius to be found by every object they touch.
+		vec3* centers = arena.allocate<vec3>(total);
+		float* radii = arena.allocate<float>(total);
+		float queryRadius = 0;
+		for (int i = 0; i < total; ++i) {
+			const PhysicsObject* po = i < count ? physicsObjects[i] : &ghosts[i - count];
+			centers[i] = po->Collider.center;
+			radii[i] = po->Collider.radius;
+			if (i < count && radii[i] > queryRadius) queryRadius = radii[i];
+		}
+		broadphase.build(centers, radii, total, 0, queryRadius);
+		
+		// Every candidate pair makes at most one contact
+		int numPairs = 0;
+		for (int i = 0; i < count; ++i) {
+			numPairs += pairCandidates(broadphase, centers[i], i, nullptr);
+		}
+		Counters::add(Counters::BroadphasePairs, numPairs);
+		
+		contacts = arena.allocate<ObjectContact>(numPairs + count * numStaticColliders);
+		numContacts = 0;
+		int* others = arena.allocate<int>(total);
+		for (int i = 0; i < count; ++i) {
+			PhysicsObject* object = physicsObjects[i];
+			ColliderShape shape = object->GetShape();
+			
+			// Check for collisions with the static colliders
+			for (int j = 0; j < numStaticColliders; ++j) {
+				AddContact(shape, staticColliders[j], object, nullptr);
+			}
+			
+			// And with the objects and ghosts close to it
+			int numOthers = pairCandidates(broadphase, centers[i], i, others);
+			for (int k = 0; k < numOthers; ++k) {
+				int j = others[k];
+				PhysicsObject* other = j < count ? physicsObjects[j] : &ghosts[j - count];
+				AddContact(shape, other->GetShape(), object, other);
+			}
+		}
+		Counters::add(Counters::NarrowphaseHits, numContacts);
+	}
+	
+	{
+		PROFILE_ZONE("Resolve contacts");
+		for (int i = 0; i < numContacts; ++i) {
+			contacts[i].object->ResolveContact(contacts[i].contact, contacts[i].other);
+		}
+	}
+	
+	// The arena is rolled back with the scope
+	contacts = nullptr;
+	numContacts = 0;
+}
+
+void PhysicsWorld::AddContact(const ColliderShape& shape, const ColliderShape& otherShape, PhysicsObject* object, PhysicsObject* other) {
+	ObjectContact& contact = contacts[numContacts];
+	if (!GenerateContact(shape, otherShape, contact.contact)) return;
+	
+	contact.object = object;
+	contact.other = other;
+	++numContacts;
+}
+
+void PhysicsWorld::AddStaticCollider(const ColliderShape& shape) {
+	assert(numStaticColliders < maxStaticColliders);
+	staticColliders[numStaticColliders++] = shape;
+}
+
+int PhysicsWorld::Count() const {
+	int count = 0;
+	while (physicsObjects[count] != nullptr) {
+		++count;
+	}
+	return count;
+}
+
+void PhysicsWorld::BuildIndex() {
+	PROFILE_ZONE("PhysicsWorld::BuildIndex");
+	
+	Memory::StackScope scope(Memory::threadArena());
+	int count = Count();
+	vec3* centers = Memory::threadArena().allocate<vec3>(count);
+	float* radii = Memory::threadArena().allocate<float>(count);
+	for (int i = 0; i < count; ++i) {
+		indexed[i] = physicsObjects[i];
+		centers[i] = physicsObjects[i]->Collider.center;
+		radii[i] = physicsObjects[i]->Collider.radius;
+	}
+	index.build(centers, radii, count);
+}
+
+bool PhysicsWorld::Raycast(const vec3& origin, const vec3& direction, float maxDistance, RaycastHit& hit) const {
+	SpatialIndex::Ray ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	ray.maxDistance = maxDistance;
+	
+	SpatialIndex::Hit indexHit;
+	bool found = index.raycast(ray, indexHit);
+	hit.object = found ? indexed[indexHit.index] : nullptr;
+	hit.distance = indexHit.distance;
+	hit.point = origin + vec3(direction).normalize() * indexHit.distance;
+	return found;
+}
+
+void PhysicsWorld::Raycast(const SpatialIndex::Ray* rays, int count, RaycastHit* hits) const {
+	Memory::StackScope scope(Memory::threadArena());
+	SpatialIndex::Hit* indexHits = Memory::threadArena().allocate<SpatialIndex::Hit>(count);
+	index.raycast(rays, count, indexHits);
+	for (int i = 0; i < count; ++i) {
+		hits[i].object = indexHits[i].index >= 0 ? indexed[indexHits[i].index] : nullptr;
+		hits[i].distance = indexHits[i].distance;
+		hits[i].point = rays[i].origin + vec3(rays[i].direction).normalize() * indexHits[i].distance;
+	}
+}
+
+int PhysicsWorld::OverlapSphere(const vec3& center, float radius, PhysicsObject** results, int maxResults) const {
+	Memory::StackScope scope(Memory::threadArena());
+	int* indices = Memory::threadArena().allocate<int>(maxResults);
+	int found = index.overlapSphere(center, radius, indices, maxResults);
+	for (int i = 0; i < found && i < maxResults; ++i) {
+		results[i] = indexed[indices[i]];
+	}
+	return found;
+}
+
+void PhysicsWorld::OverlapSphere(const vec3* centers, const float* radii, int count, PhysicsObject** results, int maxResults, int* offsets) const {
+	Memory::StackScope scope(Memory::threadArena());
+	int* indices = Memory::threadArena().allocate<int>(maxResults);
+	index.overlapSphere(centers, radii, count, indices, maxResults, offsets);
+	for (int i = 0; i < offsets[count] && i < maxResults; ++i) {
+		results[i] = indexed[indices[i]];
+	}
+}
+
+int PhysicsWorld::OverlapAABB(const vec3& min, const vec3& max, PhysicsObject** results, int maxResults) const {
+	Memory::StackScope scope(Memory::threadArena());
+	int* indices = Memory::threadArena().allocate<int>(maxResults);
+	int found = index.overlapAABB(min, max, indices, maxResults);
+	for (int i = 0; i < found && i < maxResults; ++i) {
+		results[i] = indexed[indices[i]];
+	}
+	return found;
+}
+
+int PhysicsWorld::NearestK(const vec3& point, int k, PhysicsObject** results, float* distances) const {
+	Memory::StackScope scope(Memory::threadArena());
+	int* indices = Memory::threadArena().allocate<int>(k);
+	int found = index.nearestK(point, k, indices, distances);
+	for (int i = 0; i < found; ++i) {
+		results[i] = indexed[indices[i]];
+	}
+	return found;
+}
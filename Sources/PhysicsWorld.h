@@ -3,6 +3,8 @@
 
 #include <Kore/Graphics4/Graphics.h>
 #include "Collision.h"
+#include "SpatialIndex.h"
+#include "SpatialHash.h"
 
 class PhysicsObject;
 
@@ -13,18 +15,108 @@ class PhysicsWorld {
 	// The ground plane
 	PlaneCollider plane;
 	
+	// The maximum number of simulated objects
+	static const int maxObjects = 100;
+	
+	static const int maxStaticColliders = 8;
+	
+	// Copies of objects that are simulated by neighbouring worlds (see PhysicsRegions), as many as one world simulates
+	static const int maxGhosts = maxObjects;
+	
 	// null terminated array of PhysicsObject pointers
 	PhysicsObject** physicsObjects;
 	
+	struct RaycastHit {
+		// nullptr when nothing was hit
+		PhysicsObject* object;
+		float distance;
+		vec3 point;
+	};
+	
 	PhysicsWorld();
 	
 	// Integration step
 	void Update(float deltaT);
 	
-	// Handle the collisions
+	// Integrate and handle the collisions, without updating the counters and the index
+	void Step(float deltaT);
+	
+	// Apply gravity and integrate the equations of motion, the first half of Step
+	void Integrate(float deltaT);
+	
+	// Handle the collisions: the candidate pairs come from a spatial hash over the objects and the ghosts,
+	// all contacts are generated first and then resolved
 	void HandleCollisions(float deltaT);
 	
+	// An immovable collider of any type, it has to stay valid. The ground plane is added by the constructor.
+	void AddStaticCollider(const ColliderShape& shape);
+	
+	// Collide the objects with a copy of po in the next steps. Ghosts are not simulated,
+	// what the collisions do to them is dropped, the world that owns po resolves its side of the contacts.
+	// Both worlds have to see the other's object, a contact that only one of them sees is resolved halfway.
+	void AddGhost(const PhysicsObject& po);
+	
+	void ClearGhosts();
+	
 	// Add an object to be simulated
 	void AddObject(PhysicsObject* po);
 	
+	// Stop simulating an object, the order of the remaining objects is kept
+	void RemoveObject(PhysicsObject* po);
+	
+	// The number of simulated objects
+	int Count() const;
+	
+	// Rebuild the index used by the queries, done at the end of every Update.
+	// Queries see the objects as they were at that point.
+	void BuildIndex();
+	
+	// The queries below only read the world, they may run on several threads at once while it is not updated
+	
+	// The closest object hit by the ray, direction does not need to be normalized
+	bool Raycast(const vec3& origin, const vec3& direction, float maxDistance, RaycastHit& hit) const;
+	
+	// Trace many rays at once, they share the traversal of the index
+	void Raycast(const SpatialIndex::Ray* rays, int count, RaycastHit* hits) const;
+	
+	// The objects touching the sphere, returns their number (which may be larger than maxResults)
+	int OverlapSphere(const vec3& center, float radius, PhysicsObject** results, int maxResults) const;
+	
+	// Run count sphere queries. The results of query i start at results[offsets[i]] and offsets[count] is the total.
+	void OverlapSphere(const vec3* centers, const float* radii, int count, PhysicsObject** results, int maxResults, int* offsets) const;
+	
+	// The objects touching the box, returns their number (which may be larger than maxResults)
+	int OverlapAABB(const vec3& min, const vec3& max, PhysicsObject** results, int maxResults) const;
+	
+	// The k objects with the closest surfaces, sorted by distance. Returns the number found.
+	int NearestK(const vec3& point, int k, PhysicsObject** results, float* distances = nullptr) const;
+	
+private:
+	struct ObjectContact {
+		Contact contact;
+		PhysicsObject* object;
+		// nullptr for static colliders
+		PhysicsObject* other;
+	};
+	
+	void AddContact(const ColliderShape& shape, const ColliderShape& otherShape, PhysicsObject* object, PhysicsObject* other);
+	
+	ColliderShape staticColliders[maxStaticColliders];
+	int numStaticColliders;
+	
+	PhysicsObject* ghosts;
+	int numGhosts;
+	
+	// The contacts of the current step, filled before any is resolved.
+	// Taken from the thread arena while the collisions are handled, sized by the candidate pairs.
+	ObjectContact* contacts;
+	int numContacts;
+	
+	// The objects followed by the ghosts, rebuilt every step
+	SpatialHash broadphase;
+	
+	SpatialIndex index;
+	
+	// The objects when the index was built, in the order of the index
+	PhysicsObject** indexed;
 };
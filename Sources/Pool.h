@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Memory.h"
+
+#include <assert.h>
+#include <new>
+
+// Fixed-size blocks for objects of type T, recycled through a free list.
+// Blocks are aligned to Alignment (a cache line by default) so that objects do not share cache lines.
+// Memory is taken from Memory in chunks and never given back, freed blocks are reused instead.
+template<class T, size_t Alignment = 64> class Pool {
+public:
+	Pool(Memory::Tag tag = Memory::TagGeneral, int blocksPerChunk = 64) : tag(tag), blocksPerChunk(blocksPerChunk), freeList(nullptr), live(0), blocks(0) {
+		static_assert((Alignment & (Alignment - 1)) == 0, "Alignment has to be a power of two");
+		static_assert(Alignment >= alignof(T), "Alignment is too small for T");
+	}
+	
+	// Construct a new object in a free block
+	T* create() {
+		if (freeList == nullptr) grow();
+		
+		FreeBlock* block = freeList;
+		freeList = block->next;
+		++live;
+		return new (block) T();
+	}
+	
+	// Destruct the object and recycle its block
+	void destroy(T* object) {
+		assert(object != nullptr);
+		object->~T();
+		
+		FreeBlock* block = (FreeBlock*)object;
+		block->next = freeList;
+		freeList = block;
+		--live;
+	}
+	
+	// The number of objects in use
+	int size() const {
+		return live;
+	}
+	
+	// The number of blocks, used or free
+	int capacity() const {
+		return blocks;
+	}
+	
+	static const size_t blockSize = ((sizeof(T) > sizeof(void*) ? sizeof(T) : sizeof(void*)) + Alignment - 1) & ~(Alignment - 1);
+	
+private:
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+	
+	void grow() {
+		// Memory::allocate does not align, so leave room to align the chunk
+		size_t start = (size_t)Memory::allocate(blocksPerChunk * blockSize + Alignment - 1, tag);
+		unsigned char* chunk = (unsigned char*)((start + Alignment - 1) & ~(Alignment - 1));
+		
+		// Link the blocks in address order
+		for (int i = blocksPerChunk - 1; i >= 0; --i) {
+			FreeBlock* block = (FreeBlock*)(chunk + i * blockSize);
+			block->next = freeList;
+			freeList = block;
+		}
+		blocks += blocksPerChunk;
+	}
+	
+	Pool(const Pool&);
+	Pool& operator=(const Pool&);
+	
+	Memory::Tag tag;
+	int blocksPerChunk;
+	FreeBlock* freeList;
+	int live;
+	int blocks;
+};
@@ -0,0 +1,150 @@
+#include "pch.h"
+
+#ifdef PROFILER
+
+#include "Profiler.h"
+#include "Memory.h"
+
+#include <Kore/System.h>
+#include <Kore/IO/FileWriter.h>
+#include <Kore/Log.h>
+
+#include <atomic>
+#include <new>
+#include <stdarg.h>
+#include <stdio.h>
+#include <assert.h>
+
+using namespace Kore;
+
+namespace {
+	// Zones per thread, older zones are overwritten
+	const int maxEvents = 64 * 1024;
+	const int maxDepth = 32;
+	const int maxThreads = 16;
+	
+	struct Event {
+		const char* name;
+		double start;
+		double end;
+	};
+	
+	struct ThreadBuffer {
+		int id;
+		const char* name;
+		
+		// Ring of finished zones, written only by the owning thread
+		Event* events;
+		std::atomic<unsigned> written;
+		
+		// Open zones
+		Event stack[maxDepth];
+		int depth;
+	};
+	
+	ThreadBuffer* threads[maxThreads];
+	std::atomic<int> numThreads(0);
+	
+	thread_local ThreadBuffer* current = nullptr;
+	// Set for threads that came after maxThreads, their zones are dropped
+	thread_local bool untracked = false;
+	
+	// Returns nullptr for untracked threads
+	ThreadBuffer* getThreadBuffer() {
+		if (current != nullptr || untracked) return current;
+		
+		// Threads register rarely, a counter is enough
+		int id = numThreads.fetch_add(1);
+		if (id >= maxThreads) {
+			untracked = true;
+			log(Warning, "The profiler only records %d threads, the zones of thread %d are dropped", maxThreads, id);
+			return nullptr;
+		}
+		
+		ThreadBuffer* buffer = Memory::allocate<ThreadBuffer>();
+		buffer->events = Memory::allocate<Event>(maxEvents);
+		new (&buffer->written) std::atomic<unsigned>(0);
+		buffer->depth = 0;
+		buffer->name = nullptr;
+		buffer->id = id;
+		threads[id] = buffer;
+		
+		current = buffer;
+		return buffer;
+	}
+	
+	void write(FileWriter& writer, const char* format, ...) {
+		char line[256];
+		va_list args;
+		va_start(args, format);
+		int length = vsnprintf(line, sizeof(line), format, args);
+		va_end(args);
+		if (length > (int)sizeof(line) - 1) length = sizeof(line) - 1;
+		writer.write(line, length);
+	}
+}
+
+void Profiler::begin(const char* name) {
+	ThreadBuffer* buffer = getThreadBuffer();
+	if (buffer == nullptr) return;
+	assert(buffer->depth < maxDepth);
+	Event& event = buffer->stack[buffer->depth++];
+	event.name = name;
+	event.start = System::time();
+}
+
+void Profiler::end() {
+	ThreadBuffer* buffer = current;
+	if (buffer == nullptr && untracked) return;
+	assert(buffer != nullptr && buffer->depth > 0);
+	Event& event = buffer->stack[--buffer->depth];
+	event.end = System::time();
+	
+	unsigned written = buffer->written.load(std::memory_order_relaxed);
+	buffer->events[written % maxEvents] = event;
+	buffer->written.store(written + 1, std::memory_order_release);
+}
+
+void Profiler::setThreadName(const char* name) {
+	ThreadBuffer* buffer = getThreadBuffer();
+	if (buffer != nullptr) buffer->name = name;
+}
+
+void Profiler::exportTrace(const char* filename) {
+	FileWriter writer;
+	if (!writer.open(filename)) {
+		log(Warning, "Could not write the profiler trace to %s", filename);
+		return;
+	}
+	
+	int count = numThreads.load();
+	if (count > maxThreads) count = maxThreads;
+	
+	write(writer, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (int i = 0; i < count; ++i) {
+		ThreadBuffer* buffer = threads[i];
+		// Still registering
+		if (buffer == nullptr) continue;
+		
+		if (buffer->name != nullptr) {
+			write(writer, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", buffer->id, buffer->name);
+			first = false;
+		}
+		
+		// Other threads keep recording, zones that are overwritten meanwhile may come out garbled
+		unsigned written = buffer->written.load(std::memory_order_acquire);
+		unsigned oldest = written > (unsigned)maxEvents ? written - maxEvents : 0;
+		for (unsigned j = oldest; j < written; ++j) {
+			const Event& event = buffer->events[j % maxEvents];
+			write(writer, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n", event.name, buffer->id, event.start * 1000000.0, (event.end - event.start) * 1000000.0);
+			first = false;
+		}
+	}
+	write(writer, "\n]}\n");
+	writer.close();
+	
+	log(Info, "Wrote profiler trace of %d threads to %s", count, filename);
+}
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+// Scoped CPU zones, recorded per thread and exported as Chrome trace_event JSON (open in chrome://tracing).
+// Zones are only recorded with PROFILER defined, otherwise the macros compile to nothing.
+// Enable it with project.addDefine('PROFILER') in korefile.js.
+// Up to 16 threads are recorded, the zones of any further threads are dropped.
+// Memory has to be initialized before the first zone.
+//
+//	void update() {
+//		PROFILE_ZONE("Update");
+//		...
+//	}
+
+#ifdef PROFILER
+
+namespace Profiler {
+	// Start a zone on the calling thread, zones nest
+	void begin(const char* name);
+	
+	// End the innermost zone of the calling thread
+	void end();
+	
+	// The name of the calling thread in the trace
+	void setThreadName(const char* name);
+	
+	// Write the recorded zones of all threads. Every thread keeps only its most recent zones.
+	void exportTrace(const char* filename);
+	
+	class Zone {
+	public:
+		Zone(const char* name) {
+			begin(name);
+		}
+		
+		~Zone() {
+			end();
+		}
+	};
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#define PROFILE_EXPORT(filename) Profiler::exportTrace(filename)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_EXPORT(filename)
+
+#endif
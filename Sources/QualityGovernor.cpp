@@ -0,0 +1,74 @@
+#include "pch.h"
+
+#include "QualityGovernor.h"
+
+namespace {
+	const QualityGovernor::Settings levels[QualityGovernor::levelCount] = {
+		// spawn scale, max particles, time step, lod bias
+		{ { 1.0f, 1024, 1.0f / 120.0f }, 1.0f },
+		{ { 1.6f, 700, 1.0f / 90.0f }, 0.75f },
+		{ { 2.4f, 450, 1.0f / 60.0f }, 0.5f },
+		{ { 4.0f, 250, 1.0f / 60.0f }, 0.35f }
+	};
+	
+	// Weight of a new frame in the moving average
+	const double smoothing = 0.05;
+	
+	// The part of the time step a simulation step may take, the simulation thread needs some slack to keep up
+	const double simulationBudget = 0.8;
+	
+	// Lower quality above this fraction of the budget, raise it below the other
+	const double overBudget = 1.05;
+	const double underBudget = 0.7;
+	
+	// Frames out of bounds before the level changes
+	const int framesToLower = 30;
+	const int framesToRaise = 120;
+}
+
+QualityGovernor::QualityGovernor(double budget) : budget(budget), average(0), simulationLoad(0), level(0), framesOver(0), framesUnder(0) {
+	
+}
+
+bool QualityGovernor::update(double frameTime, double stepTime, double timeStep) {
+	average = average == 0 ? frameTime : average + (frameTime - average) * smoothing;
+	double load = timeStep > 0 ? stepTime / timeStep : 0;
+	simulationLoad = simulationLoad == 0 ? load : simulationLoad + (load - simulationLoad) * smoothing;
+	
+	// Relative to the budgets, the larger one decides
+	double usage = average / budget;
+	double simulationUsage = simulationLoad / simulationBudget;
+	if (simulationUsage > usage) usage = simulationUsage;
+	
+	if (usage > overBudget) {
+		++framesOver;
+		framesUnder = 0;
+	}
+	else if (usage < underBudget) {
+		++framesUnder;
+		framesOver = 0;
+	}
+	else {
+		framesOver = 0;
+		framesUnder = 0;
+	}
+	
+	if (framesOver >= framesToLower && level < levelCount - 1) {
+		++level;
+	}
+	else if (framesUnder >= framesToRaise && level > 0) {
+		--level;
+	}
+	else {
+		return false;
+	}
+	
+	// Give the new level time to show in the average
+	framesOver = 0;
+	framesUnder = 0;
+	return true;
+}
+
+const QualityGovernor::Settings& QualityGovernor::getSettings() const {
+	return levels[level];
+}
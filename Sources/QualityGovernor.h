@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Simulation.h"
+
+// Keeps the frame time and the simulation inside their budgets by stepping through quality levels.
+// Level 0 is the full quality, every further level trades detail for time.
+// The simulation is over budget when its steps take too large a part of the time step, it then falls behind real time.
+// Whichever of the two is further over its budget decides.
+// A level is only changed after the average stayed out of bounds for a while,
+// and quality is raised more reluctantly than it is lowered, so that it does not oscillate.
+class QualityGovernor {
+public:
+	struct Settings {
+		Simulation::Quality simulation;
+		float lodBias;
+	};
+	
+	static const int levelCount = 4;
+	
+	// budget is the target frame time in seconds
+	QualityGovernor(double budget = 1.0 / 60.0);
+	
+	// Feed the time the last frame took and the step time and time step of the newest simulation snapshot,
+	// returns true when the level changed
+	bool update(double frameTime, double stepTime, double timeStep);
+	
+	int getLevel() const {
+		return level;
+	}
+	
+	const Settings& getSettings() const;
+	
+	// The moving average of the frame time
+	double getAverage() const {
+		return average;
+	}
+	
+	// The moving average of the part of the time step a simulation step takes
+	double getSimulationLoad() const {
+		return simulationLoad;
+	}
+	
+private:
+	double budget;
+	double average;
+	double simulationLoad;
+	int level;
+	
+	// Frames the average has been over or under the bounds in a row
+	int framesOver;
+	int framesUnder;
+};
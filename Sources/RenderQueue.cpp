@@ -0,0 +1,142 @@
+#include "pch.h"
+
+#include "RenderQueue.h"
+#include "Memory.h"
+#include "Profiler.h"
+#include "Counters.h"
+
+#include <Kore/Math/Core.h>
+
+#include <algorithm>
+#include <assert.h>
+
+using namespace Kore;
+
+namespace {
+	const int depthBits = 24;
+	const int textureBits = 24;
+	const int programBits = 15;
+	
+	const u64 depthMask = (1ull << depthBits) - 1;
+	const u64 textureMask = (1ull << textureBits) - 1;
+	const u64 programMask = (1ull << programBits) - 1;
+}
+
+RenderQueue::RenderQueue(int capacity) : maxDepth(100.0f), items(nullptr), keys(nullptr), capacity(capacity), count(0) {
+	stats.draws = 0;
+	stats.pipelineChanges = 0;
+	stats.textureChanges = 0;
+	stats.pipelineChangesSkipped = 0;
+	stats.textureChangesSkipped = 0;
+}
+
+void RenderQueue::begin() {
+	if (items == nullptr) {
+		items = Memory::allocate<DrawItem>(capacity);
+	}
+	// The keys are only needed until the end of the frame
+	keys = Memory::frameAllocate<SortKey>(capacity);
+	count = 0;
+}
+
+void RenderQueue::submit(ShaderProgram* program, Graphics4::Texture* texture, Graphics4::VertexBuffer* vertexBuffer, Graphics4::IndexBuffer* indexBuffer, const mat4& M, const vec4& tint, float depth) {
+	assert(count < capacity);
+	if (count >= capacity) return;
+	
+	DrawItem& item = add(program, texture, depth);
+	item.M = M;
+	item.tint = tint;
+	item.vertexBuffer = vertexBuffer;
+	item.indexBuffer = indexBuffer;
+	item.instanceBuffer = nullptr;
+	item.instanceCount = 0;
+}
+
+void RenderQueue::submitInstanced(ShaderProgram* program, Graphics4::Texture* texture, Graphics4::VertexBuffer* vertexBuffer, Graphics4::IndexBuffer* indexBuffer, Graphics4::VertexBuffer* instanceBuffer, int instanceCount, const mat4& M, const vec4& tint, float depth) {
+	assert(count < capacity);
+	if (count >= capacity || instanceCount == 0) return;
+	
+	DrawItem& item = add(program, texture, depth);
+	item.M = M;
+	item.tint = tint;
+	item.vertexBuffer = vertexBuffer;
+	item.indexBuffer = indexBuffer;
+	item.instanceBuffer = instanceBuffer;
+	item.instanceCount = instanceCount;
+}
+
+RenderQueue::DrawItem& RenderQueue::add(ShaderProgram* program, Graphics4::Texture* texture, float depth) {
+	DrawItem& item = items[count];
+	item.program = program;
+	item.texture = texture;
+	
+	float normalizedDepth = Kore::min(Kore::max(depth / maxDepth, 0.0f), 1.0f);
+	u64 quantizedDepth = (u64)(normalizedDepth * depthMask);
+	
+	// Textures only need to be grouped, so any bits of the pointer that differ between textures do
+	u64 textureKey = ((u64)(size_t)texture >> 4) & textureMask;
+	
+	u64 key;
+	if (program->isTransparent()) {
+		key = (1ull << 63) | ((u64)program->getId() & programMask) << (textureBits + depthBits) | textureKey << depthBits | (depthMask - quantizedDepth);
+	}
+	else {
+		key = ((u64)program->getId() & programMask) << (textureBits + depthBits) | textureKey << depthBits | quantizedDepth;
+	}
+	
+	keys[count].key = key;
+	keys[count].item = count;
+	++count;
+	return item;
+}
+
+void RenderQueue::flush(const SceneParameters& parameters) {
+	PROFILE_ZONE("RenderQueue::flush");
+	std::sort(keys, keys + count, keyLess);
+	
+	stats.draws = count;
+	Counters::add(Counters::DrawCalls, count);
+	stats.pipelineChanges = 0;
+	stats.textureChanges = 0;
+	
+	ShaderProgram* currentProgram = nullptr;
+	Graphics4::Texture* currentTexture = nullptr;
+	
+	for (int i = 0; i < count; ++i) {
+		DrawItem& item = items[keys[i].item];
+		
+		if (item.program != currentProgram) {
+			item.program->SetPipeline(parameters);
+			currentProgram = item.program;
+			// Texture units are bound per pipeline
+			currentTexture = nullptr;
+			++stats.pipelineChanges;
+		}
+		if (item.texture != currentTexture) {
+			item.program->SetTexture(item.texture);
+			currentTexture = item.texture;
+			++stats.textureChanges;
+		}
+		item.program->SetObject(item.M, item.tint);
+		
+		Graphics4::setIndexBuffer(*item.indexBuffer);
+		if (item.instanceBuffer != nullptr) {
+			Graphics4::VertexBuffer* vertexBuffers[] = { item.vertexBuffer, item.instanceBuffer };
+			Graphics4::setVertexBuffers(vertexBuffers, 2);
+			Graphics4::drawIndexedVerticesInstanced(item.instanceCount);
+		}
+		else {
+			Graphics4::setVertexBuffer(*item.vertexBuffer);
+			Graphics4::drawIndexedVertices();
+		}
+	}
+	
+	// ShaderProgram::Set changes both for every draw
+	stats.pipelineChangesSkipped = count - stats.pipelineChanges;
+	stats.textureChangesSkipped = count - stats.textureChanges;
+	Counters::add(Counters::StateChanges, stats.pipelineChanges + stats.textureChanges);
+	Counters::add(Counters::PipelineChangesSkipped, stats.pipelineChangesSkipped);
+	Counters::add(Counters::TextureChangesSkipped, stats.textureChangesSkipped);
+	
+	count = 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "pch.h"
+
+#include <Kore/Graphics4/Graphics.h>
+
+#include "ShaderProgram.h"
+
+// Collects the draws of a frame, sorts them by a 64 bit key and submits them while
+// only emitting pipeline and texture changes when they differ from the last draw.
+// Key layout from the most significant bit:
+// 1 bit transparent, 15 bits program, 24 bits texture, 24 bits depth.
+// Opaque draws are grouped by state and drawn front to back, transparent draws are drawn back to front.
+class RenderQueue {
+public:
+	struct Stats {
+		int draws;
+		int pipelineChanges;
+		int textureChanges;
+		
+		// State changes that a draw without the queue would have emitted but that were skipped
+		int pipelineChangesSkipped;
+		int textureChangesSkipped;
+	};
+	
+	RenderQueue(int capacity = 4096);
+	
+	// Start collecting a new frame
+	void begin();
+	
+	// Queue a draw, depth is the view space distance used for ordering
+	void submit(ShaderProgram* program, Graphics4::Texture* texture, Graphics4::VertexBuffer* vertexBuffer, Graphics4::IndexBuffer* indexBuffer, const mat4& M, const vec4& tint, float depth);
+	
+	// Queue an instanced draw, the per instance data comes from instanceBuffer (see InstancedMesh).
+	// M is the same for all instances.
+	void submitInstanced(ShaderProgram* program, Graphics4::Texture* texture, Graphics4::VertexBuffer* vertexBuffer, Graphics4::IndexBuffer* indexBuffer, Graphics4::VertexBuffer* instanceBuffer, int instanceCount, const mat4& M, const vec4& tint, float depth);
+	
+	// Sort and draw everything that was queued since begin
+	void flush(const SceneParameters& parameters);
+	
+	// The statistics of the last flush
+	const Stats& getStats() const {
+		return stats;
+	}
+	
+	// The far plane used to quantize depths
+	float maxDepth;
+	
+private:
+	struct DrawItem {
+		mat4 M;
+		vec4 tint;
+		ShaderProgram* program;
+		Graphics4::Texture* texture;
+		Graphics4::VertexBuffer* vertexBuffer;
+		Graphics4::IndexBuffer* indexBuffer;
+		
+		// nullptr for draws that are not instanced
+		Graphics4::VertexBuffer* instanceBuffer;
+		int instanceCount;
+	};
+	
+	struct SortKey {
+		u64 key;
+		int item;
+	};
+	
+	static bool keyLess(const SortKey& a, const SortKey& b) {
+		return a.key < b.key;
+	}
+	
+	DrawItem* items;
+	SortKey* keys;
+	
+	DrawItem& add(ShaderProgram* program, Graphics4::Texture* texture, float depth);
+
+	int capacity;
+	int count;
+	
+	Stats stats;
+};
@@ -4,6 +4,8 @@
 
 #include <Kore/Graphics4/Graphics.h>
 #include <Kore/Graphics4/PipelineState.h>
+#include "Archive.h"
+#include "Counters.h"
 
 using namespace Kore;
 
@@ -12,23 +14,107 @@ struct SceneParameters {
 	mat4 PV;
 	mat4 V;
 	
+	vec3 cameraPosition;
+	
+	// Element (1, 1) of the projection matrix, converts sizes at a distance to fractions of half the screen height
+	float projectionScale;
+	
+	// Scales the screen size used to select levels of detail, smaller values select simpler meshes
+	float lodBias;
+	
 	// Add particle controller here
 	vec4 tint;
 };
 
 class ShaderProgram {
 public:
-	ShaderProgram(const char* vsFile, const char* fsFile, Graphics4::VertexStructure& structure, bool depthWrite)
+	// instanceStructure is the per instance vertex data for instanced shaders (see InstancedMesh)
+	ShaderProgram(const char* vsFile, const char* fsFile, Graphics4::VertexStructure& structure, bool depthWrite, Graphics4::VertexStructure* instanceStructure = nullptr)
 	{
 		// Load and link the shaders
-		FileReader vs(vsFile);
-		FileReader fs(fsFile);
-		vertexShader = new Graphics4::Shader(vs.readAll(), vs.size(), Graphics4::VertexShader);
-		fragmentShader = new Graphics4::Shader(fs.readAll(), fs.size(), Graphics4::FragmentShader);
+		AssetFile vs(vsFile);
+		AssetFile fs(fsFile);
+		vertexShader = new Graphics4::Shader((void*)vs.data(), vs.size(), Graphics4::VertexShader);
+		fragmentShader = new Graphics4::Shader((void*)fs.data(), fs.size(), Graphics4::FragmentShader);
+		
+		createPipeline(structure, depthWrite, instanceStructure);
+	}
+	
+	// Link shaders that have already been loaded (and may be shared with other programs, see AssetCache)
+	ShaderProgram(Graphics4::Shader* vertexShader, Graphics4::Shader* fragmentShader, Graphics4::VertexStructure& structure, bool depthWrite, Graphics4::VertexStructure* instanceStructure = nullptr) : vertexShader(vertexShader), fragmentShader(fragmentShader)
+	{
+		createPipeline(structure, depthWrite, instanceStructure);
+	}
+	
+	virtual ~ShaderProgram()
+	{
+		delete pipeline;
+	}
+	
+	Graphics4::Shader* getVertexShader() const {
+		return vertexShader;
+	}
+	
+	Graphics4::Shader* getFragmentShader() const {
+		return fragmentShader;
+	}
+	
+	// Update this program from the scene parameters
+	virtual void Set(const SceneParameters& parameters, const mat4& M, Graphics4::Texture* image)
+	{
+		SetPipeline(parameters);
+		SetTexture(image);
+		SetObject(M, parameters.tint);
+	}
+	
+	// The parts of Set, so that a RenderQueue can skip the ones that did not change between draws.
+	// Important: We need to set the program before we set a uniform
+	virtual void SetPipeline(const SceneParameters& parameters)
+	{
+		Graphics4::setPipeline(pipeline);
+		Graphics4::setMatrix(pvLocation, parameters.PV);
+		Counters::add(Counters::StateChanges);
+	}
+	
+	// Sets the texture and its sampler state, textures have mipmaps (see TextureCache)
+	virtual void SetTexture(Graphics4::Texture* image)
+	{
+		Graphics4::setTexture(tex, image);
+		Graphics4::setTextureAddressing(tex, Graphics4::U, Graphics4::TextureAddressing::Repeat);
+		Graphics4::setTextureAddressing(tex, Graphics4::V, Graphics4::TextureAddressing::Repeat);
+		Graphics4::setTextureMinificationFilter(tex, Graphics4::LinearFilter);
+		Graphics4::setTextureMagnificationFilter(tex, Graphics4::LinearFilter);
+		Graphics4::setTextureMipmapFilter(tex, Graphics4::LinearMipFilter);
+		Counters::add(Counters::StateChanges);
+	}
+	
+	// Sets the per object uniforms
+	virtual void SetObject(const mat4& M, const vec4& tint)
+	{
+		Graphics4::setMatrix(mLocation, M);
+		Graphics4::setFloat4(tintLocation, tint);
+	}
+	
+	// Unique per program, used for sorting draws
+	int getId() const {
+		return id;
+	}
+	
+	// Programs that do not write depth are blended and have to be drawn back to front
+	bool isTransparent() const {
+		return !pipeline->depthWrite;
+	}
+	
+protected:
+	void createPipeline(Graphics4::VertexStructure& structure, bool depthWrite, Graphics4::VertexStructure* instanceStructure)
+	{
+		static int nextId = 0;
+		id = nextId++;
 		
 		pipeline = new Graphics4::PipelineState;
 		pipeline->inputLayout[0] = &structure;
-		pipeline->inputLayout[1] = nullptr;
+		pipeline->inputLayout[1] = instanceStructure;
+		pipeline->inputLayout[2] = nullptr;
 		pipeline->vertexShader = vertexShader;
 		pipeline->fragmentShader = fragmentShader;
 		pipeline->depthMode = Graphics4::ZCompareLess;
@@ -43,25 +129,10 @@ public:
 		tintLocation = pipeline->getConstantLocation("tint");
 	}
 	
-	// Update this program from the scene parameters
-	virtual void Set(const SceneParameters& parameters, const mat4& M, Graphics4::Texture* image)
-	{
-		// Important: We need to set the program before we set a uniform
-		Graphics4::setPipeline(pipeline);
-		
-		Graphics4::setTexture(tex, image);
-		Graphics4::setMatrix(mLocation, M);
-		Graphics4::setMatrix(pvLocation, parameters.PV);
-		Graphics4::setFloat4(tintLocation, parameters.tint);
-		
-		Graphics4::setTextureAddressing(tex, Graphics4::U, Graphics4::TextureAddressing::Repeat);
-		Graphics4::setTextureAddressing(tex, Graphics4::V, Graphics4::TextureAddressing::Repeat);
-	}
-	
-protected:
 	Graphics4::Shader* vertexShader;
 	Graphics4::Shader* fragmentShader;
 	Graphics4::PipelineState* pipeline;
+	int id;
 	
 	// Uniform locations - add more as you see fit
 	Graphics4::TextureUnit tex;
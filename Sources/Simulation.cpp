@@ -0,0 +1,295 @@
+#include "pch.h"
+
+#include "Simulation.h"
+#include "PhysicsRegions.h"
+#include "PhysicsObject.h"
+#include "Memory.h"
+#include "Pool.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include "SpatialHash.h"
+#include "Profiler.h"
+
+#include <Kore/System.h>
+#include <Kore/Threads/Thread.h>
+#include <Kore/Log.h>
+
+#include <atomic>
+
+using namespace Kore;
+
+namespace {
+	// Steps beyond this are dropped when the simulation falls behind
+	const int maxStepsPerUpdate = 4;
+	
+	// Rays traced in one step, further ones are dropped
+	const int maxHitsPerStep = 16;
+	
+	struct Command {
+		enum Type {
+			SpawnSphere,
+			ApplyImpulse,
+			ApplyImpulseToHit,
+			SetQuality
+		};
+		Type type;
+		vec3 position;
+		vec3 velocity;
+		// The ray of ApplyImpulseToHit starts at position
+		vec3 direction;
+		float maxDistance;
+		MeshObject* mesh;
+		int id;
+		Simulation::Quality quality;
+	};
+	
+	// Nine regions of 8 by 8 meters, the spawn point and the throw target at the origin are in the middle of the center one
+	PhysicsRegions physics(8.0f, 3, 3);
+	
+	// The bodies of all regions, gathered again whenever they were added, removed or handed over.
+	// The regions could hold more, but the snapshots and the body hash are sized for one world.
+	PhysicsObject* bodies[PhysicsWorld::maxObjects];
+	int numBodies = 0;
+	
+	// Spawned spheres are recycled
+	Pool<PhysicsObject>* physicsObjectPool;
+	
+	ParticleSystem* particles;
+	
+	// The bodies for the particle collisions
+	SpatialHash bodyHash(PhysicsWorld::maxObjects, 1024, Memory::TagParticles);
+	
+	// Particles only need a coarse grid
+	const float bodyCellSize = 0.5f;
+	
+	// Written by the main thread, read by the simulation thread
+	SpscQueue<Command, 256> commands;
+	
+	TripleBuffer<Simulation::Snapshot> snapshots;
+	
+	Thread* thread = nullptr;
+	std::atomic<bool> running(false);
+	
+	int steps = 0;
+	
+	float timeStep = Simulation::defaultTimeStep;
+	
+	// Traced after the step, when the indices of the regions are up to date with the spawns and despawns
+	Command hitCommands[maxHitsPerStep];
+	int numHitCommands = 0;
+	
+	void despawn(PhysicsObject* po) {
+		physics.RemoveObject(po);
+		physicsObjectPool->destroy(po);
+	}
+	
+	void spawn(const Command& command) {
+		if (numBodies == PhysicsWorld::maxObjects) {
+			PhysicsObject* oldest = bodies[0];
+			for (int i = 1; i < numBodies; ++i) {
+				if (bodies[i]->id < oldest->id) oldest = bodies[i];
+			}
+			despawn(oldest);
+		}
+		
+		PhysicsObject* po = physicsObjectPool->create();
+		po->SetPosition(command.position);
+		po->Velocity = command.velocity;
+		po->Collider.radius = 0.2f;
+		
+		po->Mass = 5;
+		po->Mesh = command.mesh;
+		
+		po->ApplyImpulse(command.velocity);
+		physics.AddObject(po);
+		numBodies = physics.Gather(bodies);
+	}
+	
+	void step() {
+		PROFILE_ZONE("Simulation step");
+		
+		Command command;
+		while (commands.pop(command)) {
+			switch (command.type) {
+			case Command::SpawnSphere:
+				spawn(command);
+				break;
+			case Command::ApplyImpulse:
+				for (int i = 0; i < numBodies; ++i) {
+					if (bodies[i]->id == command.id) {
+						bodies[i]->ApplyImpulse(command.velocity);
+						break;
+					}
+				}
+				break;
+			case Command::ApplyImpulseToHit:
+				if (numHitCommands < maxHitsPerStep) {
+					hitCommands[numHitCommands++] = command;
+				}
+				else {
+					log(Warning, "Too many rays in one simulation step, dropping an impulse");
+				}
+				break;
+			case Command::SetQuality:
+				particles->spawnScale = command.quality.spawnScale;
+				particles->maxAlive = command.quality.maxParticles;
+				timeStep = command.quality.timeStep;
+				break;
+			}
+		}
+		
+		physics.Update(timeStep);
+		numBodies = physics.Gather(bodies);
+		
+		for (int i = 0; i < numHitCommands; ++i) {
+			const Command& hitCommand = hitCommands[i];
+			PhysicsWorld::RaycastHit hit;
+			if (physics.Raycast(hitCommand.position, hitCommand.direction, hitCommand.maxDistance, hit)) {
+				hit.object->ApplyImpulse(hitCommand.velocity);
+			}
+		}
+		numHitCommands = 0;
+		particles->update(timeStep);
+		
+		if (particles->collisions.enabled) {
+			Memory::StackScope scope(Memory::threadArena());
+			vec3* centers = Memory::threadArena().allocate<vec3>(numBodies);
+			float* radii = Memory::threadArena().allocate<float>(numBodies);
+			for (int i = 0; i < numBodies; ++i) {
+				centers[i] = bodies[i]->Collider.center;
+				radii[i] = bodies[i]->Collider.radius;
+			}
+			bodyHash.build(centers, radii, numBodies, bodyCellSize, particles->collisions.radius);
+			particles->collide(physics.Plane(), bodyHash);
+		}
+		++steps;
+	}
+	
+	void publish(float stepTime) {
+		PROFILE_ZONE("Simulation publish");
+		
+		Simulation::Snapshot& snapshot = snapshots.writeBuffer();
+		
+		for (int i = 0; i < numBodies; ++i) {
+			PhysicsObject* po = bodies[i];
+			Simulation::Body& body = snapshot.bodies[i];
+			body.position = po->GetPosition();
+			body.scale = po->Scale;
+			body.radius = po->Collider.radius;
+			body.mesh = po->Mesh;
+			body.id = po->id;
+		}
+		snapshot.numBodies = numBodies;
+		snapshot.numParticles = particles->getStates(snapshot.particles);
+		snapshot.step = steps;
+		snapshot.stepTime = stepTime;
+		snapshot.timeStep = timeStep;
+		
+		snapshots.publish();
+	}
+	
+	void run(void*) {
+		PROFILE_THREAD("Simulation");
+		
+		double last = System::time();
+		double accumulated = 0;
+		while (running.load(std::memory_order_relaxed)) {
+			double now = System::time();
+			accumulated += now - last;
+			last = now;
+			
+			// Rather slow down than spiral when a step takes longer than its time step
+			if (accumulated > maxStepsPerUpdate * timeStep) {
+				accumulated = maxStepsPerUpdate * timeStep;
+			}
+			
+			if (accumulated < timeStep) {
+				threadSleep(1);
+				continue;
+			}
+			
+			int batch = 0;
+			while (accumulated >= timeStep) {
+				// Commands may change the time step, the step uses the new one
+				step();
+				accumulated -= timeStep;
+				++batch;
+			}
+			publish((float)((System::time() - now) / batch));
+		}
+	}
+}
+
+void Simulation::init(ParticleSystem* particleSystem) {
+	particles = particleSystem;
+	physicsObjectPool = new Pool<PhysicsObject>(Memory::TagPhysics);
+	
+	for (int i = 0; i < 3; ++i) {
+		Snapshot& snapshot = snapshots.buffer(i);
+		snapshot.bodies = Memory::allocate<Body>(PhysicsWorld::maxObjects, Memory::TagPhysics);
+		snapshot.numBodies = 0;
+		snapshot.particles = Memory::allocate<ParticleSystem::State>(particles->numParticles, Memory::TagParticles);
+		snapshot.numParticles = 0;
+		snapshot.step = 0;
+		snapshot.stepTime = 0;
+		snapshot.timeStep = timeStep;
+	}
+}
+
+void Simulation::start() {
+	running = true;
+	thread = createAndRunThread(run, nullptr);
+}
+
+void Simulation::stop() {
+	if (thread == nullptr) return;
+	running = false;
+	waitForThreadStopThenFree(thread);
+	thread = nullptr;
+}
+
+void Simulation::spawnSphere(vec3 position, vec3 velocity, MeshObject* mesh) {
+	Command command;
+	command.type = Command::SpawnSphere;
+	command.position = position;
+	command.velocity = velocity;
+	command.mesh = mesh;
+	if (!commands.push(command)) {
+		log(Warning, "Simulation command queue is full, dropping a spawn");
+	}
+}
+
+void Simulation::applyImpulse(int id, vec3 impulse) {
+	Command command;
+	command.type = Command::ApplyImpulse;
+	command.id = id;
+	command.velocity = impulse;
+	if (!commands.push(command)) {
+		log(Warning, "Simulation command queue is full, dropping an impulse");
+	}
+}
+
+void Simulation::applyImpulseToHit(vec3 origin, vec3 direction, float maxDistance, vec3 impulse) {
+	Command command;
+	command.type = Command::ApplyImpulseToHit;
+	command.position = origin;
+	command.direction = direction;
+	command.maxDistance = maxDistance;
+	command.velocity = impulse;
+	if (!commands.push(command)) {
+		log(Warning, "Simulation command queue is full, dropping an impulse");
+	}
+}
+
+void Simulation::setQuality(const Quality& quality) {
+	Command command;
+	command.type = Command::SetQuality;
+	command.quality = quality;
+	if (!commands.push(command)) {
+		log(Warning, "Simulation command queue is full, dropping a quality change");
+	}
+}
+
+const Simulation::Snapshot& Simulation::latest() {
+	return snapshots.readBuffer();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Kore/Math/Vector.h>
+
+#include "ParticleSystem.h"
+
+class MeshObject;
+
+// Runs the physics and the particles on their own thread with a fixed time step.
+// After each batch of steps a snapshot is published that the render thread can read at any time without waiting.
+// The simulation is changed only through commands, which are executed before the next step.
+namespace Simulation {
+	// A simulated body as the render thread sees it
+	struct Body {
+		vec3 position;
+		float scale;
+		float radius;
+		MeshObject* mesh;
+		// Identifies the body in commands
+		int id;
+	};
+	
+	struct Snapshot {
+		Body* bodies;
+		int numBodies;
+		ParticleSystem::State* particles;
+		int numParticles;
+		// The number of steps simulated so far
+		int step;
+		// Seconds one step of the last batch took on average and the time step it simulated
+		float stepTime;
+		float timeStep;
+	};
+	
+	// What the simulation may trade for time
+	struct Quality {
+		// Multiplies the seconds between two particle spawns of every emitter
+		float spawnScale;
+		// Living particles beyond this are not spawned
+		int maxParticles;
+		// The fixed time step
+		float timeStep;
+	};
+	
+	const float defaultTimeStep = 1.0f / 120.0f;
+	
+	// Takes over the particle system, it must not be updated from elsewhere afterwards
+	void init(ParticleSystem* particleSystem);
+	
+	// Start the simulation thread
+	void start();
+	
+	// Stop the simulation thread and wait for it
+	void stop();
+	
+	// Queue a new sphere, the oldest body is despawned when the world is full
+	void spawnSphere(vec3 position, vec3 velocity, MeshObject* mesh);
+	
+	// Queue an impulse for the body with the id, nothing happens when it was despawned meanwhile
+	void applyImpulse(int id, vec3 impulse);
+	
+	// Queue an impulse for the closest body hit by the ray (see PhysicsRegions::Raycast).
+	// The ray is traced after the next step, against the bodies as they are then.
+	void applyImpulseToHit(vec3 origin, vec3 direction, float maxDistance, vec3 impulse);
+	
+	// Queue a change of the quality
+	void setQuality(const Quality& quality);
+	
+	// The newest snapshot, only valid until the next call
+	const Snapshot& latest();
+}
@@ -0,0 +1,79 @@
+#include "pch.h"
+
+#include "SpatialHash.h"
+
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+using namespace Kore;
+
+namespace {
+	const int maxCellsPerSphere = 8;
+}
+
+SpatialHash::SpatialHash(int capacity, int tableSize, Memory::Tag tag) : centerX(nullptr), centerY(nullptr), centerZ(nullptr), radius(nullptr), capacity(capacity), tableSize(tableSize), tag(tag), count(0), inverseCellSize(1), bucketStart(nullptr), entries(nullptr) {
+	assert((tableSize & (tableSize - 1)) == 0);
+}
+
+void SpatialHash::build(const vec3* centers, const float* radii, int count, float cellSize, float queryRadius) {
+	assert(count <= capacity);
+	if (bucketStart == nullptr) {
+		bucketStart = Memory::allocate<int>(tableSize + 1, tag);
+		entries = Memory::allocate<int>(capacity * maxCellsPerSphere, tag);
+		x = Memory::allocate<float>(capacity, tag);
+		y = Memory::allocate<float>(capacity, tag);
+		z = Memory::allocate<float>(capacity, tag);
+		r = Memory::allocate<float>(capacity, tag);
+		centerX = x;
+		centerY = y;
+		centerZ = z;
+		radius = r;
+	}
+	
+	this->count = count;
+	for (int i = 0; i < count; ++i) {
+		x[i] = centers[i].x();
+		y[i] = centers[i].y();
+		z[i] = centers[i].z();
+		r[i] = radii[i];
+		// A little larger, so that rounding does not make a sphere touch three cells along an axis
+		float reach = radii[i] + queryRadius;
+		if (2.01f * reach > cellSize) cellSize = 2.01f * reach;
+	}
+	inverseCellSize = 1.0f / cellSize;
+	
+	// Count the entries per bucket, then turn the counts into start indices and fill the buckets
+	memset(bucketStart, 0, (tableSize + 1) * sizeof(int));
+	for (int pass = 0; pass < 2; ++pass) {
+		for (int i = 0; i < count; ++i) {
+			float reach = r[i] + queryRadius;
+			int minX = cellOf(x[i] - reach), maxX = cellOf(x[i] + reach);
+			int minY = cellOf(y[i] - reach), maxY = cellOf(y[i] + reach);
+			int minZ = cellOf(z[i] - reach), maxZ = cellOf(z[i] + reach);
+			for (int cellX = minX; cellX <= maxX; ++cellX) {
+				for (int cellY = minY; cellY <= maxY; ++cellY) {
+					for (int cellZ = minZ; cellZ <= maxZ; ++cellZ) {
+						int bucket = hash(cellX, cellY, cellZ);
+						if (pass == 0) {
+							++bucketStart[bucket + 1];
+						}
+						else {
+							// Two cells of a sphere can share a bucket, then the sphere is in it twice
+							entries[bucketStart[bucket + 1]++] = i;
+						}
+					}
+				}
+			}
+		}
+		
+		if (pass == 0) {
+			for (int bucket = 0; bucket < tableSize; ++bucket) {
+				bucketStart[bucket + 1] += bucketStart[bucket];
+			}
+			// Filling moves every start to the end of its bucket, start from the previous bucket's start
+			memmove(&bucketStart[1], &bucketStart[0], tableSize * sizeof(int));
+			bucketStart[0] = 0;
+		}
+	}
+}
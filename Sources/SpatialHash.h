@@ -0,0 +1,63 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Memory.h"
+
+using namespace Kore;
+
+// A uniform grid of spheres hashed into a fixed table, for many cheap point queries (see ParticleSystem::collide).
+// Every sphere is entered into all cells its bounds touch, so a query only looks at one bucket.
+class SpatialHash {
+public:
+	// The memory is allocated on the first build, tableSize has to be a power of two
+	SpatialHash(int capacity, int tableSize = 4096, Memory::Tag tag = Memory::TagGeneral);
+	
+	// The cells are at least as large as the largest sphere, so that a sphere touches at most 8 cells.
+	// The spheres are entered into the cells of their bounds grown by queryRadius, for queries by spheres of that radius.
+	void build(const vec3* centers, const float* radii, int count, float cellSize, float queryRadius = 0);
+	
+	// The spheres that may contain the point (or touch a query sphere centered on it), returns their number. Spheres of other cells that share the bucket are included.
+	int query(float x, float y, float z, const int*& candidates) const {
+		int bucket = hash(cellOf(x), cellOf(y), cellOf(z));
+		candidates = &entries[bucketStart[bucket]];
+		return bucketStart[bucket + 1] - bucketStart[bucket];
+	}
+	
+	// The spheres as passed to build
+	const float* centerX;
+	const float* centerY;
+	const float* centerZ;
+	const float* radius;
+	
+	int size() const {
+		return count;
+	}
+	
+private:
+	int cellOf(float value) const {
+		return (int)floorf(value * inverseCellSize);
+	}
+	
+	int hash(int x, int y, int z) const {
+		return ((unsigned)x * 73856093u ^ (unsigned)y * 19349663u ^ (unsigned)z * 83492791u) & (tableSize - 1);
+	}
+	
+	SpatialHash(const SpatialHash&);
+	SpatialHash& operator=(const SpatialHash&);
+	
+	int capacity;
+	int tableSize;
+	Memory::Tag tag;
+	int count;
+	float inverseCellSize;
+	
+	// The entries of bucket i are entries[bucketStart[i]] to entries[bucketStart[i + 1] - 1]
+	int* bucketStart;
+	int* entries;
+	
+	float* x;
+	float* y;
+	float* z;
+	float* r;
+};
@@ -0,0 +1,412 @@
+#include "pch.h"
+
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	const int maxLeafSize = 4;
+	
+	// Deep enough for a hierarchy over millions of spheres
+	const int maxStackDepth = 64;
+	
+	// Rays per packet, one bit each in a mask
+	const int packetSize = 32;
+	
+	// The index of the lowest set bit, mask must not be 0
+	int lowestBit(unsigned mask) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (int)index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+	
+	struct AxisLess {
+		int axis;
+		
+		template<class T> bool operator()(const T& a, const T& b) const {
+			return a.center[axis] < b.center[axis];
+		}
+	};
+	
+	// The ray enters the box between 0 and maxDistance
+	bool intersectsBox(const float* min, const float* max, const float* origin, const float* inverseDirection, float maxDistance) {
+		float enter = 0;
+		float exit = maxDistance;
+		for (int axis = 0; axis < 3; ++axis) {
+			float first = (min[axis] - origin[axis]) * inverseDirection[axis];
+			float second = (max[axis] - origin[axis]) * inverseDirection[axis];
+			if (first > second) std::swap(first, second);
+			// Written so that NaNs from rays parallel to a side are ignored
+			if (first > enter) enter = first;
+			if (second < exit) exit = second;
+			if (enter > exit) return false;
+		}
+		return true;
+	}
+	
+	// Distance along the normalized direction to the sphere, negative when missed. 0 when the ray starts inside.
+	float intersectSphere(const float* center, float radius, const float* origin, const float* direction) {
+		float offset[3] = { origin[0] - center[0], origin[1] - center[1], origin[2] - center[2] };
+		float b = offset[0] * direction[0] + offset[1] * direction[1] + offset[2] * direction[2];
+		float c = offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2] - radius * radius;
+		if (c <= 0) return 0;
+		if (b > 0) return -1;
+		float discriminant = b * b - c;
+		if (discriminant < 0) return -1;
+		return -b - sqrtf(discriminant);
+	}
+	
+	float squaredDistanceToBox(const float* point, const float* min, const float* max) {
+		float distance = 0;
+		for (int axis = 0; axis < 3; ++axis) {
+			float d = 0;
+			if (point[axis] < min[axis]) d = min[axis] - point[axis];
+			else if (point[axis] > max[axis]) d = point[axis] - max[axis];
+			distance += d * d;
+		}
+		return distance;
+	}
+	
+	bool boxesOverlap(const float* minA, const float* maxA, const float* minB, const float* maxB) {
+		return minA[0] <= maxB[0] && maxA[0] >= minB[0] && minA[1] <= maxB[1] && maxA[1] >= minB[1] && minA[2] <= maxB[2] && maxA[2] >= minB[2];
+	}
+	
+	struct PreparedRay {
+		float origin[3];
+		float direction[3];
+		float inverseDirection[3];
+	};
+	
+	void prepare(const SpatialIndex::Ray& ray, PreparedRay& prepared) {
+		float length = ray.direction.getLength();
+		float scale = length > 0 ? 1.0f / length : 0.0f;
+		for (int axis = 0; axis < 3; ++axis) {
+			prepared.origin[axis] = ray.origin[axis];
+			prepared.direction[axis] = ray.direction[axis] * scale;
+			prepared.inverseDirection[axis] = 1.0f / prepared.direction[axis];
+		}
+	}
+}
+
+SpatialIndex::SpatialIndex(int capacity, Memory::Tag tag) : capacity(capacity), tag(tag), count(0), numNodes(0), nodes(nullptr), spheres(nullptr) {
+	
+}
+
+void SpatialIndex::build(const vec3* centers, const float* radii, int count) {
+	assert(count <= capacity);
+	if (nodes == nullptr) {
+		nodes = Memory::allocate<Node>(capacity * 2, tag);
+		spheres = Memory::allocate<Sphere>(capacity, tag);
+	}
+	this->count = count;
+	for (int i = 0; i < count; ++i) {
+		spheres[i].center[0] = centers[i].x();
+		spheres[i].center[1] = centers[i].y();
+		spheres[i].center[2] = centers[i].z();
+		spheres[i].radius = radii[i];
+		spheres[i].index = i;
+	}
+	
+	numNodes = 1;
+	if (count == 0) {
+		nodes[0].count = 0;
+		nodes[0].first = 0;
+		for (int axis = 0; axis < 3; ++axis) {
+			nodes[0].min[axis] = FLT_MAX;
+			nodes[0].max[axis] = -FLT_MAX;
+		}
+		return;
+	}
+	buildNode(0, 0, count);
+}
+
+int SpatialIndex::buildNode(int nodeIndex, int first, int count) {
+	Node& node = nodes[nodeIndex];
+	float centerMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float centerMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int axis = 0; axis < 3; ++axis) {
+		node.min[axis] = FLT_MAX;
+		node.max[axis] = -FLT_MAX;
+	}
+	for (int i = first; i < first + count; ++i) {
+		const Sphere& sphere = spheres[i];
+		for (int axis = 0; axis < 3; ++axis) {
+			node.min[axis] = std::min(node.min[axis], sphere.center[axis] - sphere.radius);
+			node.max[axis] = std::max(node.max[axis], sphere.center[axis] + sphere.radius);
+			centerMin[axis] = std::min(centerMin[axis], sphere.center[axis]);
+			centerMax[axis] = std::max(centerMax[axis], sphere.center[axis]);
+		}
+	}
+	
+	if (count <= maxLeafSize) {
+		node.first = first;
+		node.count = count;
+		return 1;
+	}
+	
+	// Split at the median of the longest axis of the centers
+	AxisLess less;
+	less.axis = 0;
+	for (int axis = 1; axis < 3; ++axis) {
+		if (centerMax[axis] - centerMin[axis] > centerMax[less.axis] - centerMin[less.axis]) less.axis = axis;
+	}
+	int half = count / 2;
+	std::nth_element(spheres + first, spheres + first + half, spheres + first + count, less);
+	
+	int children = numNodes;
+	numNodes += 2;
+	node.first = children;
+	node.count = 0;
+	int depth = std::max(buildNode(children, first, half), buildNode(children + 1, first + half, count - half));
+	assert(depth < maxStackDepth);
+	return depth + 1;
+}
+
+bool SpatialIndex::raycast(const Ray& ray, Hit& hit) const {
+	PreparedRay prepared;
+	prepare(ray, prepared);
+	
+	hit.index = -1;
+	hit.distance = ray.maxDistance;
+	if (count == 0) return false;
+	
+	int stack[maxStackDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (!intersectsBox(node.min, node.max, prepared.origin, prepared.inverseDirection, hit.distance)) continue;
+		
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+		
+		for (int i = node.first; i < node.first + node.count; ++i) {
+			float distance = intersectSphere(spheres[i].center, spheres[i].radius, prepared.origin, prepared.direction);
+			if (distance >= 0 && distance <= hit.distance) {
+				hit.distance = distance;
+				hit.index = spheres[i].index;
+			}
+		}
+	}
+	return hit.index >= 0;
+}
+
+void SpatialIndex::raycast(const Ray* rays, int count, Hit* hits) const {
+	if (this->count == 0) {
+		for (int i = 0; i < count; ++i) {
+			hits[i].index = -1;
+			hits[i].distance = rays[i].maxDistance;
+		}
+		return;
+	}
+	
+	PreparedRay prepared[packetSize];
+	
+	struct Entry {
+		int node;
+		unsigned mask;
+	};
+	Entry stack[maxStackDepth];
+	
+	for (int start = 0; start < count; start += packetSize) {
+		int packetCount = std::min(packetSize, count - start);
+		const Ray* packetRays = &rays[start];
+		Hit* packetHits = &hits[start];
+		for (int i = 0; i < packetCount; ++i) {
+			prepare(packetRays[i], prepared[i]);
+			packetHits[i].index = -1;
+			packetHits[i].distance = packetRays[i].maxDistance;
+		}
+		
+		// Every node is visited once for all rays of the packet that reach it
+		int top = 0;
+		stack[top].node = 0;
+		stack[top].mask = packetCount == 32 ? 0xffffffffu : (1u << packetCount) - 1;
+		++top;
+		while (top > 0) {
+			Entry entry = stack[--top];
+			const Node& node = nodes[entry.node];
+			
+			unsigned mask = 0;
+			for (unsigned remaining = entry.mask; remaining != 0; remaining &= remaining - 1) {
+				int ray = lowestBit(remaining);
+				if (intersectsBox(node.min, node.max, prepared[ray].origin, prepared[ray].inverseDirection, packetHits[ray].distance)) mask |= 1u << ray;
+			}
+			if (mask == 0) continue;
+			
+			if (node.count == 0) {
+				stack[top].node = node.first;
+				stack[top].mask = mask;
+				++top;
+				stack[top].node = node.first + 1;
+				stack[top].mask = mask;
+				++top;
+				continue;
+			}
+			
+			for (int i = node.first; i < node.first + node.count; ++i) {
+				for (unsigned remaining = mask; remaining != 0; remaining &= remaining - 1) {
+					int ray = lowestBit(remaining);
+					float distance = intersectSphere(spheres[i].center, spheres[i].radius, prepared[ray].origin, prepared[ray].direction);
+					if (distance >= 0 && distance <= packetHits[ray].distance) {
+						packetHits[ray].distance = distance;
+						packetHits[ray].index = spheres[i].index;
+					}
+				}
+			}
+		}
+	}
+}
+
+int SpatialIndex::overlapSphere(const vec3& center, float radius, int* results, int maxResults) const {
+	if (count == 0) return 0;
+	
+	float point[3] = { center.x(), center.y(), center.z() };
+	int found = 0;
+	
+	int stack[maxStackDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (squaredDistanceToBox(point, node.min, node.max) > radius * radius) continue;
+		
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+		
+		for (int i = node.first; i < node.first + node.count; ++i) {
+			const Sphere& sphere = spheres[i];
+			float dx = sphere.center[0] - point[0];
+			float dy = sphere.center[1] - point[1];
+			float dz = sphere.center[2] - point[2];
+			float reach = sphere.radius + radius;
+			if (dx * dx + dy * dy + dz * dz > reach * reach) continue;
+			
+			if (found < maxResults) results[found] = sphere.index;
+			++found;
+		}
+	}
+	return found;
+}
+
+void SpatialIndex::overlapSphere(const vec3* centers, const float* radii, int count, int* results, int maxResults, int* offsets) const {
+	int total = 0;
+	for (int i = 0; i < count; ++i) {
+		offsets[i] = total;
+		int room = std::max(0, maxResults - total);
+		total += overlapSphere(centers[i], radii[i], &results[std::min(total, maxResults)], room);
+	}
+	offsets[count] = total;
+}
+
+int SpatialIndex::overlapAABB(const vec3& min, const vec3& max, int* results, int maxResults) const {
+	if (count == 0) return 0;
+	
+	float boxMin[3] = { min.x(), min.y(), min.z() };
+	float boxMax[3] = { max.x(), max.y(), max.z() };
+	int found = 0;
+	
+	int stack[maxStackDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (!boxesOverlap(node.min, node.max, boxMin, boxMax)) continue;
+		
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+		
+		for (int i = node.first; i < node.first + node.count; ++i) {
+			const Sphere& sphere = spheres[i];
+			if (squaredDistanceToBox(sphere.center, boxMin, boxMax) > sphere.radius * sphere.radius) continue;
+			
+			if (found < maxResults) results[found] = sphere.index;
+			++found;
+		}
+	}
+	return found;
+}
+
+int SpatialIndex::nearestK(const vec3& point, int k, int* results, float* distances) const {
+	if (count == 0 || k <= 0) return 0;
+	
+	float position[3] = { point.x(), point.y(), point.z() };
+	
+	// The best spheres so far, sorted by distance
+	Memory::StackScope scope(Memory::threadArena());
+	float* best = Memory::threadArena().allocate<float>(k);
+	int found = 0;
+	
+	struct Entry {
+		int node;
+		float distance;
+	};
+	Entry stack[maxStackDepth];
+	int top = 0;
+	stack[top].node = 0;
+	stack[top].distance = sqrtf(squaredDistanceToBox(position, nodes[0].min, nodes[0].max));
+	++top;
+	while (top > 0) {
+		Entry entry = stack[--top];
+		if (found == k && entry.distance >= best[k - 1]) continue;
+		const Node& node = nodes[entry.node];
+		
+		if (node.count == 0) {
+			// Push the nearer child last so that it is visited first
+			Entry a = { node.first, sqrtf(squaredDistanceToBox(position, nodes[node.first].min, nodes[node.first].max)) };
+			Entry b = { node.first + 1, sqrtf(squaredDistanceToBox(position, nodes[node.first + 1].min, nodes[node.first + 1].max)) };
+			if (a.distance < b.distance) std::swap(a, b);
+			stack[top++] = a;
+			stack[top++] = b;
+			continue;
+		}
+		
+		for (int i = node.first; i < node.first + node.count; ++i) {
+			const Sphere& sphere = spheres[i];
+			float dx = sphere.center[0] - position[0];
+			float dy = sphere.center[1] - position[1];
+			float dz = sphere.center[2] - position[2];
+			float distance = std::max(0.0f, sqrtf(dx * dx + dy * dy + dz * dz) - sphere.radius);
+			if (found == k && distance >= best[k - 1]) continue;
+			
+			// Insertion into the sorted list
+			int slot = found < k ? found++ : k - 1;
+			while (slot > 0 && best[slot - 1] > distance) {
+				best[slot] = best[slot - 1];
+				results[slot] = results[slot - 1];
+				--slot;
+			}
+			best[slot] = distance;
+			results[slot] = sphere.index;
+		}
+	}
+	
+	if (distances != nullptr) {
+		for (int i = 0; i < found; ++i) {
+			distances[i] = best[i];
+		}
+	}
+	return found;
+}
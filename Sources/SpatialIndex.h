@@ -0,0 +1,87 @@
+#pragma once
+
+#include "pch.h"
+
+#include "Memory.h"
+
+using namespace Kore;
+
+// A bounding volume hierarchy over spheres for ray, overlap and nearest neighbour queries.
+// Queries do not change the index, any number of threads may query it as long as nobody rebuilds it.
+// Results are the indices of the spheres as they were passed to build.
+class SpatialIndex {
+public:
+	struct Ray {
+		vec3 origin;
+		// Does not need to be normalized
+		vec3 direction;
+		float maxDistance;
+	};
+	
+	struct Hit {
+		// -1 when nothing was hit
+		int index;
+		// Along the normalized direction
+		float distance;
+	};
+	
+	// The memory is allocated on the first build
+	SpatialIndex(int capacity, Memory::Tag tag = Memory::TagGeneral);
+	
+	// Rebuild the hierarchy for count spheres
+	void build(const vec3* centers, const float* radii, int count);
+	
+	// The closest sphere hit by the ray
+	bool raycast(const Ray& ray, Hit& hit) const;
+	
+	// Rays are traced in packets that share the traversal of the hierarchy
+	void raycast(const Ray* rays, int count, Hit* hits) const;
+	
+	// The spheres touching the query sphere, returns their number (which may be larger than maxResults)
+	int overlapSphere(const vec3& center, float radius, int* results, int maxResults) const;
+	
+	// Run count sphere queries. The results of query i start at results[offsets[i]] and offsets[count] is the total.
+	// Results beyond maxResults are counted but not written.
+	void overlapSphere(const vec3* centers, const float* radii, int count, int* results, int maxResults, int* offsets) const;
+	
+	// The spheres touching the box, returns their number (which may be larger than maxResults)
+	int overlapAABB(const vec3& min, const vec3& max, int* results, int maxResults) const;
+	
+	// The k spheres with the closest surfaces, sorted by distance. Returns the number found, at most k.
+	// distances may be nullptr.
+	int nearestK(const vec3& point, int k, int* results, float* distances) const;
+	
+	int size() const {
+		return count;
+	}
+	
+private:
+	struct Node {
+		float min[3];
+		float max[3];
+		// Index of the first child for inner nodes (the second one follows it), of the first sphere for leaves
+		int first;
+		// Number of spheres, 0 for inner nodes
+		int count;
+	};
+	
+	struct Sphere {
+		float center[3];
+		float radius;
+		// The index passed to build
+		int index;
+	};
+	
+	int buildNode(int nodeIndex, int first, int count);
+	
+	SpatialIndex(const SpatialIndex&);
+	SpatialIndex& operator=(const SpatialIndex&);
+	
+	int capacity;
+	Memory::Tag tag;
+	int count;
+	int numNodes;
+	Node* nodes;
+	// Sorted into leaf order
+	Sphere* spheres;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+
+// A bounded queue for exactly one producer thread and one consumer thread, without locks.
+template<class T, int capacity> class SpscQueue {
+public:
+	SpscQueue() : head(0), tail(0) {
+		
+	}
+	
+	// Producer only, returns false when the queue is full
+	bool push(const T& item) {
+		int currentTail = tail.load(std::memory_order_relaxed);
+		int next = (currentTail + 1) % capacity;
+		if (next == head.load(std::memory_order_acquire)) return false;
+		items[currentTail] = item;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+	
+	// Consumer only, returns false when the queue is empty
+	bool pop(T& item) {
+		int currentHead = head.load(std::memory_order_relaxed);
+		if (currentHead == tail.load(std::memory_order_acquire)) return false;
+		item = items[currentHead];
+		head.store((currentHead + 1) % capacity, std::memory_order_release);
+		return true;
+	}
+	
+private:
+	T items[capacity];
+	
+	// Written by the consumer
+	std::atomic<int> head;
+	// Written by the producer
+	std::atomic<int> tail;
+};
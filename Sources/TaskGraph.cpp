@@ -0,0 +1,130 @@
+#include "pch.h"
+
+#include "TaskGraph.h"
+#include "Jobs.h"
+#include "Profiler.h"
+
+#include <Kore/System.h>
+#include <Kore/Log.h>
+#include <assert.h>
+
+using namespace Kore;
+
+TaskGraph::TaskGraph() : numTasks(0), finished(0), startTime(0), totalTime(0), mainQueued(0) {
+	mutex.Create();
+	signal.create(0, maxTasks + 1);
+}
+
+TaskGraph::~TaskGraph() {
+	signal.destroy();
+}
+
+int TaskGraph::add(const char* name, Affinity affinity, TaskFunction function, void* param) {
+	assert(numTasks < maxTasks);
+	Task& task = tasks[numTasks];
+	task.name = name;
+	task.affinity = affinity;
+	task.function = function;
+	task.param = param;
+	task.numDependencies = 0;
+	task.numDependents = 0;
+	task.waiting = 0;
+	task.start = 0;
+	task.end = 0;
+	task.graph = this;
+	return numTasks++;
+}
+
+void TaskGraph::depend(int task, int dependency) {
+	assert(task != dependency && tasks[task].numDependencies < maxLinks && tasks[dependency].numDependents < maxLinks);
+	tasks[task].dependencies[tasks[task].numDependencies++] = dependency;
+	tasks[dependency].dependents[tasks[dependency].numDependents++] = task;
+}
+
+void TaskGraph::runWorkerTask(void* param) {
+	Task* task = (Task*)param;
+	task->graph->execute(*task);
+}
+
+void TaskGraph::execute(Task& task) {
+	{
+		PROFILE_ZONE(task.name);
+		task.start = System::time() - startTime;
+		task.function(task.param);
+		task.end = System::time() - startTime;
+	}
+	
+	for (int i = 0; i < task.numDependents; ++i) {
+		Task& dependent = tasks[task.dependents[i]];
+		if (dependent.waiting.fetch_sub(1) == 1) schedule(dependent);
+	}
+	
+	if (finished.fetch_add(1) + 1 == numTasks) {
+		signal.release();
+	}
+}
+
+void TaskGraph::schedule(Task& task) {
+	if (task.affinity == Worker) {
+		Jobs::add(runWorkerTask, &task);
+		return;
+	}
+	mutex.Lock();
+	mainQueue[mainQueued++] = (int)(&task - tasks);
+	mutex.Unlock();
+	signal.release();
+}
+
+void TaskGraph::run() {
+	startTime = System::time();
+	for (int i = 0; i < numTasks; ++i) {
+		tasks[i].waiting = tasks[i].numDependencies;
+	}
+	for (int i = 0; i < numTasks; ++i) {
+		if (tasks[i].numDependencies == 0) schedule(tasks[i]);
+	}
+	
+	// Run the main tasks as they become ready, the workers do the rest meanwhile
+	while (finished.load() < numTasks) {
+		signal.acquire();
+		for (;;) {
+			mutex.Lock();
+			int next = mainQueued > 0 ? mainQueue[--mainQueued] : -1;
+			mutex.Unlock();
+			if (next < 0) break;
+			execute(tasks[next]);
+		}
+	}
+	totalTime = System::time() - startTime;
+}
+
+void TaskGraph::report() const {
+	log(Info, "Startup took %.1f ms", totalTime * 1000.0);
+	for (int i = 0; i < numTasks; ++i) {
+		const Task& task = tasks[i];
+		log(Info, "  %-32s %-6s %7.1f - %7.1f ms (%.1f ms)", task.name, task.affinity == Main ? "main" : "worker", task.start * 1000.0, task.end * 1000.0, (task.end - task.start) * 1000.0);
+	}
+	
+	// Walk back from the task that ended last, always to the dependency that ended last
+	int current = -1;
+	for (int i = 0; i < numTasks; ++i) {
+		if (current < 0 || tasks[i].end > tasks[current].end) current = i;
+	}
+	int path[maxTasks];
+	int length = 0;
+	while (current >= 0) {
+		path[length++] = current;
+		const Task& task = tasks[current];
+		current = -1;
+		for (int i = 0; i < task.numDependencies; ++i) {
+			int dependency = task.dependencies[i];
+			if (current < 0 || tasks[dependency].end > tasks[current].end) current = dependency;
+		}
+	}
+	
+	log(Info, "Critical path:");
+	for (int i = length - 1; i >= 0; --i) {
+		const Task& task = tasks[path[i]];
+		log(Info, "  %-32s %.1f ms", task.name, (task.end - task.start) * 1000.0);
+	}
+}
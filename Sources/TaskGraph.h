@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Kore/Threads/Mutex.h>
+#include <Kore/Threads/Semaphore.h>
+
+#include <atomic>
+
+// Runs tasks once all their dependencies are done. Worker tasks run on the Jobs threads, main tasks
+// (e.g. everything that creates GPU resources) run on the thread that calls run().
+// Every task is timed, report() logs the times and the critical path, the chain of dependencies that decided the total.
+class TaskGraph {
+public:
+	enum Affinity {
+		Worker,
+		Main
+	};
+	
+	typedef void (*TaskFunction)(void* param);
+	
+	static const int maxTasks = 64;
+	static const int maxLinks = 16;
+	
+	TaskGraph();
+	~TaskGraph();
+	
+	// Returns the id of the task, name has to stay valid for the lifetime of the graph
+	int add(const char* name, Affinity affinity, TaskFunction function, void* param = nullptr);
+	
+	// task does not start before dependency is done
+	void depend(int task, int dependency);
+	
+	// Run all tasks and return when they are done, can only be called once
+	void run();
+	
+	// Log when every task ran and the critical path
+	void report() const;
+	
+private:
+	struct Task {
+		const char* name;
+		Affinity affinity;
+		TaskFunction function;
+		void* param;
+		
+		int dependencies[maxLinks];
+		int numDependencies;
+		int dependents[maxLinks];
+		int numDependents;
+		
+		// Dependencies that are not done yet
+		std::atomic<int> waiting;
+		
+		// Seconds since run() started
+		double start;
+		double end;
+		
+		TaskGraph* graph;
+	};
+	
+	static void runWorkerTask(void* param);
+	void execute(Task& task);
+	void schedule(Task& task);
+	
+	Task tasks[maxTasks];
+	int numTasks;
+	std::atomic<int> finished;
+	double startTime;
+	double totalTime;
+	
+	// The main tasks that are ready, protected by mutex
+	int mainQueue[maxTasks];
+	int mainQueued;
+	Kore::Mutex mutex;
+	
+	// Released for every ready main task and when the last task is done
+	Kore::Semaphore signal;
+};
@@ -0,0 +1,242 @@
+#include "pch.h"
+
+#include "TextureCache.h"
+#include "Profiler.h"
+#include "Counters.h"
+
+#include <Kore/Graphics1/Image.h>
+#include <Kore/Log.h>
+#include <Kore/Math/Core.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	const u32 cacheMagic = 0x5845544b; // "KTEX"
+	const u32 cacheVersion = 1;
+	const int alignment = 16;
+	
+	// The layout of a cache file, the levels follow at their offsets
+	struct CacheHeader {
+		u32 magic;
+		u32 version;
+		u64 sourceHash;
+		u32 width;
+		u32 height;
+		u32 levels;
+		u32 padding;
+		u32 offsets[CachedTexture::maxLevels];
+	};
+	
+	int levelWidth(const CachedTexture* cached, int level) {
+		return Kore::max(cached->width >> level, 1);
+	}
+	
+	int levelHeight(const CachedTexture* cached, int level) {
+		return Kore::max(cached->height >> level, 1);
+	}
+	
+	int levelSize(const CachedTexture* cached, int level) {
+		return levelWidth(cached, level) * levelHeight(cached, level) * 4;
+	}
+	
+	// FNV-1a over 8 bytes at a time, the hash only has to tell different sources apart
+	u64 hashData(const u8* data, int size) {
+		u64 hash = 14695981039346656037ull;
+		int i = 0;
+		for (; i + 8 <= size; i += 8) {
+			u64 word;
+			memcpy(&word, &data[i], 8);
+			hash = (hash ^ word) * 1099511628211ull;
+		}
+		for (; i < size; ++i) {
+			hash = (hash ^ data[i]) * 1099511628211ull;
+		}
+		return hash ^ (u64)size;
+	}
+	
+	// Point the levels of cached into a cache file, returns false when it does not match the source
+	bool read(CachedTexture* cached, const u8* data, size_t size, u64 sourceHash) {
+		if (size < sizeof(CacheHeader)) return false;
+		const CacheHeader* header = (const CacheHeader*)data;
+		if (header->magic != cacheMagic || header->version != cacheVersion || header->sourceHash != sourceHash) return false;
+		if (header->levels == 0 || header->levels > (u32)CachedTexture::maxLevels) return false;
+		
+		cached->width = header->width;
+		cached->height = header->height;
+		cached->levels = header->levels;
+		for (int level = 0; level < cached->levels; ++level) {
+			if (header->offsets[level] + (size_t)levelSize(cached, level) > size) return false;
+			cached->pixels[level] = data + header->offsets[level];
+		}
+		return true;
+	}
+	
+	// Decode the source and average 2x2 pixels per level, odd sizes repeat the last row or column.
+	// Returns the decoded image instead when it can not be cached.
+	Image* build(CachedTexture* cached, const char* filename, const AssetFile& source, CacheHeader& header) {
+		PROFILE_ZONE("TextureCache::build");
+		
+		const char* extension = strrchr(filename, '.');
+		AssetFileReader reader(source);
+		Image* decoded = new Image(reader, extension != nullptr ? extension + 1 : "", true);
+		if (decoded->format != Image::RGBA32) {
+			log(Warning, "%s is not RGBA32, it is not cached", filename);
+			return decoded;
+		}
+		
+		cached->width = decoded->width;
+		cached->height = decoded->height;
+		cached->levels = 1;
+		while (cached->levels < CachedTexture::maxLevels && (cached->width >> cached->levels > 0 || cached->height >> cached->levels > 0)) {
+			++cached->levels;
+		}
+		
+		int offset = (sizeof(CacheHeader) + alignment - 1) / alignment * alignment;
+		for (int level = 0; level < cached->levels; ++level) {
+			header.offsets[level] = offset;
+			offset += (levelSize(cached, level) + alignment - 1) / alignment * alignment;
+		}
+		for (int level = cached->levels; level < CachedTexture::maxLevels; ++level) {
+			header.offsets[level] = 0;
+		}
+		
+		// The buffer has the layout of the cache file
+		cached->buffer = new u8[offset];
+		memset(cached->buffer, 0, sizeof(CacheHeader));
+		for (int level = 0; level < cached->levels; ++level) {
+			cached->pixels[level] = cached->buffer + header.offsets[level];
+		}
+		memcpy(cached->buffer + header.offsets[0], decoded->data, levelSize(cached, 0));
+		
+		for (int level = 1; level < cached->levels; ++level) {
+			const u8* above = cached->pixels[level - 1];
+			u8* pixels = cached->buffer + header.offsets[level];
+			int aboveWidth = levelWidth(cached, level - 1);
+			int aboveHeight = levelHeight(cached, level - 1);
+			int width = levelWidth(cached, level);
+			int height = levelHeight(cached, level);
+			for (int y = 0; y < height; ++y) {
+				const u8* row0 = &above[Kore::min(y * 2, aboveHeight - 1) * aboveWidth * 4];
+				const u8* row1 = &above[Kore::min(y * 2 + 1, aboveHeight - 1) * aboveWidth * 4];
+				for (int x = 0; x < width; ++x) {
+					int x0 = Kore::min(x * 2, aboveWidth - 1) * 4;
+					int x1 = Kore::min(x * 2 + 1, aboveWidth - 1) * 4;
+					for (int c = 0; c < 4; ++c) {
+						pixels[(y * width + x) * 4 + c] = (u8)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+					}
+				}
+			}
+		}
+		delete decoded;
+		return nullptr;
+	}
+	
+	// Write to a temporary file first, so that other instances never map half a cache file
+	void write(const char* cacheName, const CachedTexture* cached, const CacheHeader& header) {
+#ifdef _WIN32
+		_mkdir("TextureCache");
+#else
+		mkdir("TextureCache", 0755);
+#endif
+		
+		char temporary[128];
+		snprintf(temporary, sizeof(temporary), "%s.tmp", cacheName);
+		FILE* file = fopen(temporary, "wb");
+		if (file == nullptr) {
+			log(Warning, "Could not write %s", cacheName);
+			return;
+		}
+		
+		int size = header.offsets[cached->levels - 1] + levelSize(cached, cached->levels - 1);
+		memcpy(cached->buffer, &header, sizeof(header));
+		bool written = fwrite(cached->buffer, 1, size, file) == (size_t)size;
+		written = fclose(file) == 0 && written;
+		if (!written || rename(temporary, cacheName) != 0) {
+			remove(temporary);
+		}
+	}
+}
+
+CachedTexture::CachedTexture() : width(0), height(0), levels(0), packed(nullptr), buffer(nullptr) {
+	
+}
+
+CachedTexture::~CachedTexture() {
+	delete packed;
+	delete[] buffer;
+}
+
+CachedTexture* TextureCache::load(const char* filename, Image** uncached) {
+	PROFILE_ZONE("TextureCache::load");
+	*uncached = nullptr;
+	
+	// Only the bytes of the source are needed for the key, decoding it is what the cache saves
+	AssetFile source(filename);
+	u64 hash = hashData((const u8*)source.data(), source.size());
+	char cacheName[64];
+	snprintf(cacheName, sizeof(cacheName), "TextureCache/%016llx.tex", (unsigned long long)hash);
+	
+	CachedTexture* cached = new CachedTexture;
+	if (Archive::find(cacheName) != nullptr) {
+		cached->packed = new AssetFile(cacheName);
+		if (read(cached, (const u8*)cached->packed->data(), cached->packed->size(), hash)) return cached;
+	}
+	else if (cached->mapped.open(cacheName)) {
+		if (read(cached, cached->mapped.data(), cached->mapped.size(), hash)) return cached;
+	}
+	
+	// Missing or outdated
+	delete cached;
+	cached = new CachedTexture;
+	CacheHeader header;
+	header.magic = cacheMagic;
+	header.version = cacheVersion;
+	header.sourceHash = hash;
+	*uncached = build(cached, filename, source, header);
+	if (*uncached != nullptr) {
+		delete cached;
+		return nullptr;
+	}
+	header.width = cached->width;
+	header.height = cached->height;
+	header.levels = cached->levels;
+	header.padding = 0;
+	write(cacheName, cached, header);
+	return cached;
+}
+
+Graphics4::Texture* TextureCache::upload(CachedTexture* cached) {
+	Graphics4::Texture* texture = nullptr;
+	for (int level = 0; level < cached->levels; ++level) {
+		int width = levelWidth(cached, level);
+		int height = levelHeight(cached, level);
+		
+		// The smaller levels are only kept until their pixels were copied into texture
+		Graphics4::Texture* target = new Graphics4::Texture(width, height, Image::RGBA32, level > 0);
+		u8* pixels = target->lock();
+		int stride = target->stride();
+		for (int y = 0; y < height; ++y) {
+			memcpy(&pixels[y * stride], &cached->pixels[level][y * width * 4], width * 4);
+		}
+		target->unlock();
+		Counters::add(Counters::BytesUploaded, stride * height);
+		
+		if (level == 0) {
+			texture = target;
+		}
+		else {
+			texture->setMipmap(target, level);
+			delete target;
+		}
+	}
+	delete cached;
+	return texture;
+}
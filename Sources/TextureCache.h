@@ -0,0 +1,40 @@
+#pragma once
+
+#include "pch.h"
+
+#include <Kore/Graphics4/Graphics.h>
+
+#include "Archive.h"
+
+// Decoded RGBA32 pixels of a texture and its mip chain. The pixels are used in place when they come
+// from a mapped cache file, every level is tightly packed and starts 16 byte aligned.
+struct CachedTexture {
+	static const int maxLevels = 16;
+	
+	int width;
+	int height;
+	int levels;
+	
+	// Level i is max(width >> i, 1) by max(height >> i, 1) pixels
+	const Kore::u8* pixels[maxLevels];
+	
+	// What holds the pixels: the archive, a mapped cache file or a buffer filled on a cache miss
+	AssetFile* packed;
+	MappedFile mapped;
+	Kore::u8* buffer;
+	
+	CachedTexture();
+	~CachedTexture();
+};
+
+// Makes sure that images are decoded only once. The decoded pixels and a box filtered mip chain are written to
+// TextureCache/<hash of the source file>.tex on first use and mapped on later launches. Cache files are looked
+// up in the archive first, so they can be packed with the other assets (see Tools/Packer).
+namespace TextureCache {
+	// Map or decode filename, can be called on any thread. Images that are not RGBA32 are not cached,
+	// for them nullptr is returned and uncached receives the decoded image, which the caller owns.
+	CachedTexture* load(const char* filename, Kore::Image** uncached);
+	
+	// Create the texture with all levels and free cached, has to be called on the render thread
+	Kore::Graphics4::Texture* upload(CachedTexture* cached);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+
+// Hands the newest version of a value from one writer thread to one reader thread without locks.
+// The writer fills writeBuffer() and publishes it, the reader always gets the newest published buffer.
+// Neither side ever waits, older versions that were never read are overwritten.
+template<class T> class TripleBuffer {
+public:
+	TripleBuffer() : back(0), middle(1), front(2) {
+		
+	}
+	
+	// Only to be used by the writer
+	T& writeBuffer() {
+		return buffers[back];
+	}
+	
+	// Make the write buffer the newest version
+	void publish() {
+		back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & indexMask;
+	}
+	
+	// Only to be used by the reader. Returns the newest published version.
+	T& readBuffer() {
+		if (middle.load(std::memory_order_relaxed) & freshBit) {
+			front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+		}
+		return buffers[front];
+	}
+	
+	// All three buffers, to initialize them before the threads start
+	T& buffer(int index) {
+		return buffers[index];
+	}
+	
+private:
+	static const int indexMask = 3;
+	static const int freshBit = 4;
+	
+	T buffers[3];
+	
+	// Owned by the writer
+	int back;
+	// The index of the buffer in between and whether it is newer than the one the reader holds
+	std::atomic<int> middle;
+	// Owned by the reader
+	int front;
+};
@@ -0,0 +1,28 @@
+#version 450
+
+// The compressed vertex layout, see AssetLoader::compressedStructure
+in vec4 pos;
+in vec2 tex;
+in vec2 nor;
+out vec2 texCoord;
+out vec3 normal;
+uniform mat4 PV;
+// Includes the transformation from the quantized positions to mesh space
+uniform mat4 M;
+
+const float uvRange = 8.0;
+
+vec3 decodeOctahedral(vec2 e) {
+	vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(n.yx)) * signs;
+	}
+	return normalize(n);
+}
+
+void kore() {
+	gl_Position = PV * M * vec4(pos.x, pos.y, pos.z, 1.0);
+	texCoord = tex * uvRange;
+	normal = (PV * M * vec4(decodeOctahedral(nor), 0.0)).xyz;
+}
@@ -0,0 +1,16 @@
+#version 450
+
+in vec3 pos;
+in vec2 tex;
+in vec3 nor;
+in vec4 instance;
+out vec2 texCoord;
+out vec3 normal;
+uniform mat4 PV;
+
+void kore() {
+	// instance.xyz is the position, instance.w the scale
+	gl_Position = PV * vec4(pos * instance.w + instance.xyz, 1.0);
+	texCoord = tex;
+	normal = (PV * vec4(nor, 0.0)).xyz;
+}
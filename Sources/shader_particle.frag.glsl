@@ -0,0 +1,14 @@
+#version 450
+
+uniform vec4 tint;
+
+uniform sampler2D tex;
+
+in vec2 texCoord;
+in vec4 particleTint;
+
+out vec4 FragColor;
+
+void main() {
+	FragColor = texture(tex, texCoord) * particleTint * tint;
+}
@@ -0,0 +1,19 @@
+#version 450
+
+in vec3 pos;
+in vec2 tex;
+in vec3 nor;
+in vec4 instance;
+in vec4 instanceTint;
+out vec2 texCoord;
+out vec4 particleTint;
+uniform mat4 PV;
+uniform mat4 M;
+
+void kore() {
+	// M turns the quad towards the camera, instance.xyz is the position, instance.w the size
+	vec3 corner = (M * vec4(pos * instance.w, 0.0)).xyz;
+	gl_Position = PV * vec4(corner + instance.xyz, 1.0);
+	texCoord = tex;
+	particleTint = instanceTint;
+}
@@ -0,0 +1,182 @@
+// Packs a directory into an asset archive (see Sources/ArchiveFormat.h and Sources/Archive.h).
+// Run it after building, so that the compiled shaders are packed too:
+//   Packer Deployment Deployment/assets.pak
+// Entries are compressed with LZ4 when that saves at least an eighth, --store packs everything uncompressed.
+// The packer only needs a C++11 compiler, e.g. g++ -std=c++11 -O2 -I../../Sources Packer.cpp -o Packer
+
+#include "ArchiveFormat.h"
+#include "LZ4.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+	struct File {
+		// Relative to the packed directory with / as the separator
+		std::string name;
+		uint64_t hash;
+		std::vector<uint8_t> stored;
+		uint32_t size;
+		uint32_t flags;
+	};
+	
+	// Adds the paths of all files below directory, relative to it
+	void listFiles(const std::string& directory, const std::string& prefix, std::vector<std::string>& files) {
+		std::string path = prefix.empty() ? directory : directory + "/" + prefix;
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((path + "/*").c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE) return;
+		do {
+			std::string name = data.cFileName;
+			if (name[0] == '.') continue;
+			std::string relative = prefix.empty() ? name : prefix + "/" + name;
+			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) listFiles(directory, relative, files);
+			else files.push_back(relative);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+#else
+		DIR* dir = opendir(path.c_str());
+		if (dir == nullptr) return;
+		while (dirent* entry = readdir(dir)) {
+			std::string name = entry->d_name;
+			if (name[0] == '.') continue;
+			std::string relative = prefix.empty() ? name : prefix + "/" + name;
+			struct stat status;
+			if (stat((directory + "/" + relative).c_str(), &status) != 0) continue;
+			if (S_ISDIR(status.st_mode)) listFiles(directory, relative, files);
+			else if (S_ISREG(status.st_mode)) files.push_back(relative);
+		}
+		closedir(dir);
+#endif
+	}
+	
+	bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (file == nullptr) return false;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		data.resize(size);
+		bool read = size == 0 || fread(data.data(), 1, size, file) == (size_t)size;
+		fclose(file);
+		return read;
+	}
+	
+	void pad(FILE* file, uint64_t& offset) {
+		static const uint8_t zeros[archiveAlignment] = {};
+		uint64_t padding = (archiveAlignment - offset % archiveAlignment) % archiveAlignment;
+		fwrite(zeros, 1, (size_t)padding, file);
+		offset += padding;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: Packer <directory> <archive> [--store]\n");
+		return 1;
+	}
+	std::string directory = argv[1];
+	std::string archive = argv[2];
+	bool compress = !(argc > 3 && strcmp(argv[3], "--store") == 0);
+	
+	std::vector<std::string> names;
+	listFiles(directory, "", names);
+	
+	std::vector<File> files;
+	std::vector<int> table(1 << 16);
+	uint64_t totalSize = 0;
+	uint64_t totalStored = 0;
+	for (const std::string& name : names) {
+		// Do not pack older archives
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".pak") == 0) continue;
+		std::string path = directory + "/" + name;
+		
+		File file;
+		file.name = name;
+		file.hash = archiveHash(name.c_str());
+		file.flags = 0;
+		if (!readFile(path, file.stored)) {
+			fprintf(stderr, "Could not read %s\n", path.c_str());
+			return 1;
+		}
+		file.size = (uint32_t)file.stored.size();
+		
+		if (compress && file.size > 0) {
+			std::vector<uint8_t> compressed(LZ4::compressBound(file.size));
+			int compressedSize = LZ4::compress(file.stored.data(), file.size, compressed.data(), table.data());
+			if (compressedSize < (int)(file.size - file.size / 8)) {
+				compressed.resize(compressedSize);
+				file.stored.swap(compressed);
+				file.flags |= ArchiveEntryLZ4;
+			}
+		}
+		
+		totalSize += file.size;
+		totalStored += file.stored.size();
+		files.push_back(file);
+	}
+	
+	// Equal hashes end up next to each other
+	std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.hash < b.hash; });
+	for (size_t i = 1; i < files.size(); ++i) {
+		if (files[i].hash == files[i - 1].hash) printf("%s and %s have the same hash\n", files[i - 1].name.c_str(), files[i].name.c_str());
+	}
+	
+	// Names follow the index, the data of every entry starts aligned
+	std::vector<char> namesData;
+	std::vector<ArchiveEntry> entries(files.size());
+	for (size_t i = 0; i < files.size(); ++i) {
+		entries[i].hash = files[i].hash;
+		entries[i].nameOffset = (uint32_t)namesData.size();
+		entries[i].flags = files[i].flags;
+		entries[i].size = files[i].size;
+		entries[i].storedSize = (uint32_t)files[i].stored.size();
+		namesData.insert(namesData.end(), files[i].name.begin(), files[i].name.end());
+		namesData.push_back(0);
+	}
+	
+	ArchiveHeader header;
+	header.magic = archiveMagic;
+	header.version = archiveVersion;
+	header.numEntries = (uint32_t)files.size();
+	header.namesOffset = (uint32_t)(sizeof(ArchiveHeader) + entries.size() * sizeof(ArchiveEntry));
+	
+	uint64_t offset = header.namesOffset + namesData.size();
+	for (size_t i = 0; i < files.size(); ++i) {
+		offset += (archiveAlignment - offset % archiveAlignment) % archiveAlignment;
+		entries[i].offset = offset;
+		offset += entries[i].storedSize;
+	}
+	
+	FILE* output = fopen(archive.c_str(), "wb");
+	if (output == nullptr) {
+		fprintf(stderr, "Could not write %s\n", archive.c_str());
+		return 1;
+	}
+	fwrite(&header, sizeof(header), 1, output);
+	fwrite(entries.data(), sizeof(ArchiveEntry), entries.size(), output);
+	fwrite(namesData.data(), 1, namesData.size(), output);
+	offset = header.namesOffset + namesData.size();
+	for (size_t i = 0; i < files.size(); ++i) {
+		pad(output, offset);
+		fwrite(files[i].stored.data(), 1, files[i].stored.size(), output);
+		offset += files[i].stored.size();
+	}
+	fclose(output);
+	
+	printf("Packed %d files, %llu bytes stored as %llu\n", (int)files.size(), (unsigned long long)totalSize, (unsigned long long)totalStored);
+	return 0;
+}
@@ -3,6 +3,8 @@ var project = new Project('Exercise8', __dirname);
 project.addFile('Sources/**');
 project.setDebugDir('Deployment');
 project.cpp11 = true;
+// Records the zones of Sources/Profiler.h and exports them as a Chrome trace
+//project.addDefine('PROFILER');
 
 Project.createProject('Kore', __dirname).then((subproject) => {
 	project.addSubProject(subproject);